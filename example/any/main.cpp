@@ -33,5 +33,14 @@ int main()
     std::cout << str << " \n" ;
     std::cout << leaf::Any::Cast<std::string>(any) << " \n";
 
+    // ------------------------
+    std::cout << "Copying (deep, not shared) \n";
+
+    leaf::Any copy = any;
+    leaf::Any::Cast<std::string>(copy) = "copy";
+
+    std::cout << leaf::Any::Cast<std::string>(any) << " \n";
+    std::cout << leaf::Any::Cast<std::string>(copy) << " \n";
+
     return 0;
 }
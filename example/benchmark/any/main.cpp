@@ -0,0 +1,107 @@
+#include <chrono>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <iostream>
+
+#include <leaf/map/Any.h>
+
+// Previous leaf::Any, shared_ptr content and dynamic_pointer_cast
+class LegacyAny
+{
+public:
+    LegacyAny() = default;
+
+    template <typename _TypeT>
+    LegacyAny &operator=(const _TypeT &val)
+    {
+        _content.reset(new AnyType<_TypeT>(val));
+        return *this;
+    }
+
+    template <typename _TypeT>
+    static _TypeT &Cast(const LegacyAny &any)
+    {
+        auto ptr = std::dynamic_pointer_cast<AnyType<_TypeT>>(any._content);
+
+        if (!ptr)
+        {
+            throw std::bad_cast();
+        }
+
+        return ptr -> data;
+    }
+
+private:
+    struct AnyTypeBase
+    {
+        virtual ~AnyTypeBase() = default;
+    };
+
+    template <typename _TypeT>
+    struct AnyType : public AnyTypeBase
+    {
+        _TypeT data;
+        explicit AnyType(const _TypeT &d) : data(d) {}
+    };
+
+    std::shared_ptr<AnyTypeBase> _content;
+};
+
+static const int64_t Iterations = 10000000;
+
+// Average ns per call of f
+template <typename _FuncT>
+double measure(_FuncT f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (int64_t i = 0; i < Iterations; i++)
+    {
+        f(i);
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / Iterations;
+}
+
+template <typename _AnyT>
+void benchmark(const char *name)
+{
+    volatile int64_t sink = 0;
+    _AnyT any;
+
+    std::cout << name << "\n";
+
+    // ------------------------
+    any = int64_t(1);
+    std::cout << "  Cast integer      " << measure([&](int64_t i) {
+        sink = _AnyT::template Cast<int64_t>(any) + i;
+    }) << " ns/op \n";
+
+    // ------------------------
+    std::cout << "  Store integer     " << measure([&](int64_t i) {
+        any = i;
+    }) << " ns/op \n";
+
+    // ------------------------
+    any = std::string("leaf");
+    std::cout << "  Cast string       " << measure([&](int64_t i) {
+        sink = _AnyT::template Cast<std::string>(any).size() + i;
+    }) << " ns/op \n";
+
+    // ------------------------
+    any = 0.5f;
+    std::cout << "  Copy float        " << measure([&](int64_t i) {
+        _AnyT copy = any;
+        sink = (int64_t)_AnyT::template Cast<float>(copy) + i;
+    }) << " ns/op \n";
+}
+
+int main()
+{
+    benchmark<LegacyAny>("Legacy Any (shared_ptr, dynamic_pointer_cast)");
+    benchmark<leaf::Any>("leaf::Any (inline storage, type tag)");
+
+    return 0;
+}
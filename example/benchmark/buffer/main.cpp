@@ -0,0 +1,72 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <leaf/buffer/Buffer.h>
+#include <leaf/buffer/RingQueue.h>
+
+typedef std::shared_ptr<int64_t> frame_ptr;
+
+static const int64_t Frames = 2000000;
+static const size_t Capacity = 1024;
+
+// One producer thread feeding one consumer thread, returns ns per frame
+template <typename _QueueT>
+double measure()
+{
+    _QueueT queue(Capacity);
+    std::vector<frame_ptr> frames(Capacity);
+
+    for (size_t i = 0; i < Capacity; i++)
+    {
+        frames[i] = std::make_shared<int64_t>(i);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (int64_t i = 0; i < Frames; i++)
+        {
+            frame_ptr frame = frames[i % Capacity];
+
+            while (!queue.try_push(frame))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    frame_ptr frame;
+    int64_t sum = 0;
+
+    for (int64_t i = 0; i < Frames; i++)
+    {
+        while (!queue.try_pop(frame))
+        {
+            std::this_thread::yield();
+        }
+        sum += *frame;
+    }
+
+    producer.join();
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (sum < 0)
+    {
+        std::cout << sum;
+    }
+
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / Frames;
+}
+
+int main()
+{
+    std::cout << "TBBQueue  " << measure<leaf::TBBQueue<frame_ptr>>() << " ns/frame \n";
+    std::cout << "SPSCRing  " << measure<leaf::SPSCRing<frame_ptr>>() << " ns/frame \n";
+    std::cout << "MPMCRing  " << measure<leaf::MPMCRing<frame_ptr>>() << " ns/frame \n";
+
+    return 0;
+}
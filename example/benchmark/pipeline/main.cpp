@@ -0,0 +1,96 @@
+#include <string>
+#include <iostream>
+
+#include <leaf/frame/Frame.h>
+#include <leaf/frame/PooledFrame.h>
+#include <leaf/pipeline/Pipeline.h>
+
+struct Counter
+{
+    int64_t value = 0;
+};
+
+typedef leaf::PooledFrame<Counter> CounterFrame;
+
+static const int64_t Frames = 500000;
+static const int Stages = 8;
+
+class Increase : public leaf::Module<CounterFrame>
+{
+public:
+    void update(CounterFrame::ptr &frame) override
+    {
+        frame->value++;
+    }
+};
+
+// Linear chain of cheap modules, cost is dominated by passing frames between stages
+class ChainPipeline : public leaf::Pipeline<CounterFrame>
+{
+public:
+    ChainPipeline() : leaf::Pipeline<CounterFrame>(256)
+    {
+        std::string previous = GraphInputNode();
+
+        for (int i = 0; i < Stages; i++)
+        {
+            std::string name = "stage" + std::to_string(i);
+
+            add_module<Increase>(name, tbb::flow::unlimited);
+            connect_module(previous, name);
+            previous = name;
+        }
+
+        connect_module(previous, DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Two parallel branches joined before end
+class FanOutPipeline : public leaf::Pipeline<CounterFrame>
+{
+public:
+    FanOutPipeline() : leaf::Pipeline<CounterFrame>(256)
+    {
+        add_module<Increase>("left", tbb::flow::unlimited);
+        add_module<Increase>("right", tbb::flow::unlimited);
+        add_module<Increase>("merge", tbb::flow::unlimited);
+        connect_module(GraphInputNode(), "left");
+        connect_module(GraphInputNode(), "right");
+        connect_module("left", "merge");
+        connect_module("right", "merge");
+        connect_module("merge", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Push frames through pipeline, returns ns per frame
+template <class _PipeT>
+double run()
+{
+    _PipeT pipeline;
+    uint64_t t0 = leaf::Statistic::Now();
+
+    for (int64_t i = 0; i < Frames; i++)
+    {
+        pipeline.push_frame(CounterFrame::Create());
+    }
+    pipeline.wait_finish();
+
+    return (double)(leaf::Statistic::Now() - t0) / Frames;
+}
+
+int main()
+{
+    // ------------------------
+    std::cout << "Chain of " << Stages << " modules \n";
+
+    std::cout << run<ChainPipeline>() << " ns/frame \n";
+
+    // ------------------------
+    std::cout << "Fan-out of 2 branches and join \n";
+
+    std::cout << run<FanOutPipeline>() << " ns/frame \n";
+
+    return 0;
+}
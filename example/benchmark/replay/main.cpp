@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <string>
+#include <iostream>
+
+#include <leaf/frame/Frame.h>
+#include <leaf/frame/MappedFrame.h>
+#include <leaf/buffer/MappedReplayBuffer.h>
+#include <leaf/pipeline/Pipeline.h>
+#include <leaf/pipeline/ReplayRecorder.h>
+
+struct Sample
+{
+    int64_t index;
+    double values[14];
+};
+
+typedef leaf::Frame<Sample> SampleFrame;
+
+static const int64_t Frames = 200000;
+static const char *RecordPath = "replay-benchmark.rec";
+
+// Write samples into replay file, 1 ms apart in recorded time
+class SampleRecorder : public leaf::ReplayRecorder<SampleFrame>
+{
+protected:
+    std::string record_path() override
+    {
+        return RecordPath;
+    }
+
+    bool encode(SampleFrame::ptr &frame, std::string &payload) override
+    {
+        payload.assign((const char *)frame.get(), sizeof(Sample));
+        return true;
+    }
+
+    uint64_t timestamp(SampleFrame::ptr &frame) override
+    {
+        return frame->index * 1000000;
+    }
+};
+
+class RecordPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    RecordPipeline() : leaf::Pipeline<SampleFrame>(256)
+    {
+        add_module<SampleRecorder>("recorder", 1);
+        order_module("recorder");
+        connect_module(GraphInputNode(), "recorder");
+        connect_module("recorder", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Sum replayed samples in place, no copy out of mapping
+class SampleReader : public leaf::Module<leaf::MappedFrame>
+{
+public:
+    void update(leaf::MappedFrame::ptr &frame) override
+    {
+        const Sample *sample = frame->as<Sample>();
+
+        if (sample != nullptr)
+        {
+            sum += sample->index;
+        }
+    }
+
+    static std::atomic<int64_t> sum;
+};
+
+std::atomic<int64_t> SampleReader::sum(0);
+
+class ReplayPipeline : public leaf::Pipeline<leaf::MappedFrame>
+{
+public:
+    ReplayPipeline() : leaf::Pipeline<leaf::MappedFrame>(256)
+    {
+        add_module<SampleReader>("reader", 4);
+        connect_module(GraphInputNode(), "reader");
+        connect_module("reader", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Replay file through pipeline at speed, returns frames per second
+double replay(double speed, int64_t frames)
+{
+    leaf::MappedReplayBuffer<> buffer(1024);
+    ReplayPipeline pipeline;
+
+    if (!buffer.open(RecordPath))
+    {
+        return 0;
+    }
+
+    buffer.set_rate(speed);
+    SampleReader::sum = 0;
+
+    uint64_t t0 = leaf::Statistic::Now();
+
+    for (int64_t i = 0; i < frames && buffer.source_active(); i++)
+    {
+        buffer.pull_source();
+        pipeline.push_frame(buffer.pop_frame());
+    }
+    pipeline.wait_finish();
+
+    return frames * 1e9 / (leaf::Statistic::Now() - t0);
+}
+
+int main()
+{
+    {
+        RecordPipeline pipeline;
+
+        for (int64_t i = 0; i < Frames; i++)
+        {
+            SampleFrame::ptr frame = SampleFrame::Create();
+            frame->index = i;
+            pipeline.push_frame(frame);
+        }
+        pipeline.wait_finish();
+    }
+
+    // ------------------------
+    std::cout << "Replay as fast as possible \n";
+
+    std::cout << replay(0, Frames) << " frames/s, checksum " << SampleReader::sum << " \n";
+
+    // ------------------------
+    std::cout << "Replay 10x real time, recorded at 1000 frames/s \n";
+
+    std::cout << replay(10, 20000) << " frames/s \n";
+
+    std::remove(RecordPath);
+
+    return 0;
+}
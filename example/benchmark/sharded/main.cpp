@@ -0,0 +1,118 @@
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <leaf/frame/Frame.h>
+#include <leaf/pipeline/Pipeline.h>
+#include <leaf/pipeline/ShardedPipeline.h>
+
+struct Tile
+{
+    std::vector<int64_t> pixels;
+    int64_t sum = 0;
+};
+
+typedef leaf::Frame<Tile> TileFrame;
+
+static const int64_t Frames = 20000;
+static const size_t Pixels = 16384;
+
+// First touch of frame memory happens on thread running the pipeline
+class Fill : public leaf::Module<TileFrame>
+{
+public:
+    void update(TileFrame::ptr &frame) override
+    {
+        frame->pixels.resize(Pixels);
+
+        for (size_t i = 0; i < Pixels; i++)
+        {
+            frame->pixels[i] = i;
+        }
+    }
+};
+
+class Reduce : public leaf::Module<TileFrame>
+{
+public:
+    void update(TileFrame::ptr &frame) override
+    {
+        for (int pass = 0; pass < 4; pass++)
+        {
+            for (auto pixel : frame->pixels)
+            {
+                frame->sum += pixel;
+            }
+        }
+    }
+};
+
+class TilePipeline : public leaf::Pipeline<TileFrame>
+{
+public:
+    TilePipeline() : leaf::Pipeline<TileFrame>(256)
+    {
+        add_module<Fill>("fill", tbb::flow::unlimited);
+        add_module<Reduce>("reduce", tbb::flow::unlimited);
+        connect_module(GraphInputNode(), "fill");
+        connect_module("fill", "reduce");
+        connect_module("reduce", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Push frames from one producer thread per shard, returns frames per second
+double run(leaf::ShardedPipeline<TileFrame> &sharded)
+{
+    std::vector<std::thread> producers;
+    uint64_t t0 = leaf::Statistic::Now();
+
+    for (size_t shard = 0; shard < sharded.shard_count(); shard++)
+    {
+        producers.emplace_back([&sharded, shard]() {
+            for (int64_t i = 0; i < Frames / (int64_t)sharded.shard_count(); i++)
+            {
+                sharded.push_frame(shard, TileFrame::Create());
+            }
+        });
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+    sharded.wait_finish();
+
+    return Frames * 1e9 / (leaf::Statistic::Now() - t0);
+}
+
+int main()
+{
+    std::vector<std::vector<int32_t>> nodes = leaf::ShardedPipeline<TileFrame>::NumaNodes();
+    std::vector<int32_t> all_cpus;
+
+    for (auto &cpus : nodes)
+    {
+        all_cpus.insert(all_cpus.end(), cpus.begin(), cpus.end());
+    }
+
+    auto create = [](size_t) -> leaf::Pipeline<TileFrame> * { return new TilePipeline(); };
+
+    // ------------------------
+    std::cout << "One pipeline over all " << nodes.size() << " NUMA nodes \n";
+    {
+        leaf::ShardedPipeline<TileFrame> sharded(create, std::vector<std::vector<int32_t>>(1, all_cpus));
+        std::cout << run(sharded) << " frames/s \n";
+    }
+
+    // ------------------------
+    for (size_t count = 1; count <= nodes.size(); count++)
+    {
+        std::cout << "One pipeline per NUMA node, " << count << " nodes \n";
+
+        leaf::ShardedPipeline<TileFrame> sharded(create, std::vector<std::vector<int32_t>>(nodes.begin(), nodes.begin() + count));
+        std::cout << run(sharded) << " frames/s \n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+
+#include <leaf/pipeline/Statistic.h>
+
+static const int64_t Iterations = 10000000;
+
+// Average ns per call of f
+template <typename _FuncT>
+double measure(_FuncT f)
+{
+    uint64_t t0 = leaf::Statistic::Now();
+
+    for (int64_t i = 0; i < Iterations; i++)
+    {
+        f(i);
+    }
+
+    return (double)(leaf::Statistic::Now() - t0) / Iterations;
+}
+
+int main()
+{
+    volatile int64_t sink = 0;
+    leaf::RuntimeRecorder *recorder = leaf::Statistic::Resolve("resolved");
+
+    // ------------------------
+    std::cout << "Empty module call \n";
+
+    std::cout << measure([&](int64_t i) { sink = i; }) << " ns/call \n";
+
+    // ------------------------
+    std::cout << "Timing off, runtime switch only \n";
+
+    leaf::Statistic::StopRecording();
+
+    std::cout << measure([&](int64_t i) {
+        if (leaf::Statistic::IsRecording())
+        {
+            uint64_t t0 = leaf::Statistic::Now();
+            sink = i;
+            recorder->record(leaf::Statistic::Now() - t0);
+        }
+        else
+        {
+            sink = i;
+        }
+    }) << " ns/call \n";
+
+    // ------------------------
+    std::cout << "Timing on, pre-resolved recorder \n";
+
+    leaf::Statistic::StartRecording();
+
+    std::cout << measure([&](int64_t i) {
+        if (leaf::Statistic::IsRecording())
+        {
+            uint64_t t0 = leaf::Statistic::Now();
+            sink = i;
+            recorder->record(leaf::Statistic::Now() - t0);
+        }
+        else
+        {
+            sink = i;
+        }
+    }) << " ns/call \n";
+
+    // ------------------------
+    std::cout << "Timing on, record by module name \n";
+
+    std::cout << measure([&](int64_t i) {
+        uint64_t t0 = leaf::Statistic::Now();
+        sink = i;
+        leaf::Statistic::RecordRuntime("by-name", (leaf::Statistic::Now() - t0) / 1e6f);
+    }) << " ns/call \n";
+
+    leaf::Statistic::PrintStatistic();
+
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <tbb/global_control.h>
+
+#include <leaf/pipeline/Pipeline.h>
+
+struct Sample
+{
+    int64_t index = 0;
+    int64_t value = 0;
+    bool left = false;
+    bool right = false;
+};
+
+static const int64_t Frames = 10000;
+
+// Checks shared by modules of the running example
+struct Checks
+{
+    static Checks &Get()
+    {
+        static Checks checks;
+        return checks;
+    }
+
+    void reset()
+    {
+        received = 0;
+        wrong = 0;
+        batches = 0;
+        max_batch = 0;
+        released.clear();
+    }
+
+    std::atomic<int64_t> received;
+    std::atomic<int64_t> wrong;
+    std::atomic<int64_t> batches;
+    std::atomic<size_t> max_batch;
+
+    std::mutex mutex;
+    std::vector<int64_t> released;
+};
+
+// Frame type of leaf Pipeline, Dispose is called at [Dataframe_EOL] for the frame
+// pointer of every branch, last one releases the sample
+struct SampleFrame
+{
+    typedef std::shared_ptr<Sample> ptr;
+
+    static ptr Create()
+    {
+        return std::make_shared<Sample>();
+    }
+
+    static void Dispose(ptr &frame)
+    {
+        if (frame != nullptr && frame.use_count() == 1)
+        {
+            std::lock_guard<std::mutex> lock(Checks::Get().mutex);
+            Checks::Get().released.push_back(frame->index);
+        }
+        frame.reset();
+    }
+};
+
+class Increase : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        frame->value++;
+    }
+};
+
+// Expects frame passed through both modules in front of it
+class Count : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        Checks::Get().received++;
+
+        if (frame->value != 2)
+        {
+            Checks::Get().wrong++;
+        }
+    }
+};
+
+// Takes uneven time, so parallel frames leave out of push order
+class Shuffle : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        if (frame->index % 7 == 0)
+        {
+            std::this_thread::yield();
+        }
+        frame->value++;
+    }
+};
+
+class Left : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        frame->left = true;
+    }
+};
+
+class Right : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        frame->right = true;
+    }
+};
+
+// Joined frame must carry work of both branches
+class Merge : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        Checks::Get().received++;
+
+        if (!frame->left || !frame->right)
+        {
+            Checks::Get().wrong++;
+        }
+    }
+};
+
+class Batch : public leaf::Module<SampleFrame>
+{
+public:
+    void update(SampleFrame::ptr &frame) override
+    {
+        frame->value++;
+    }
+
+    void update_batch(std::vector<SampleFrame::ptr> &frames) override
+    {
+        Checks &checks = Checks::Get();
+
+        checks.batches++;
+        if (frames.size() > checks.max_batch)
+        {
+            checks.max_batch = frames.size();
+        }
+
+        for (auto &frame : frames)
+        {
+            update(frame);
+        }
+    }
+};
+
+// Push frames with increasing index, wait until all left pipeline
+bool push(leaf::Pipeline<SampleFrame> &pipeline)
+{
+    for (int64_t i = 0; i < Frames; i++)
+    {
+        SampleFrame::ptr frame = SampleFrame::Create();
+        frame->index = i;
+        pipeline.push_frame(frame);
+    }
+    pipeline.wait_finish();
+
+    return true;
+}
+
+// Every frame received once and passed checks, every frame released
+bool delivered()
+{
+    Checks &checks = Checks::Get();
+
+    std::cout << checks.received << " of " << Frames << " frames, " << checks.wrong << " wrong \n";
+    return checks.received == Frames && checks.wrong == 0 && (int64_t)checks.released.size() == Frames;
+}
+
+// ------------------------
+// Few tokens, so producer has to wait for frames to leave pipeline
+class BlockPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    BlockPipeline() : leaf::Pipeline<SampleFrame>(4, leaf::Admission::Block)
+    {
+        add_module<Increase>("first", 2);
+        add_module<Increase>("second", 2);
+        add_module<Count>("count", 1);
+        connect_module(GraphInputNode(), "first");
+        connect_module("first", "second");
+        connect_module("second", "count");
+        connect_module("count", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Two branches forked from input and joined again before merge
+class DiamondPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    DiamondPipeline() : leaf::Pipeline<SampleFrame>(64)
+    {
+        add_module<Left>("left", 2);
+        add_module<Right>("right", 2);
+        add_module<Merge>("merge", 1);
+        connect_module(GraphInputNode(), "left");
+        connect_module(GraphInputNode(), "right");
+        connect_module("left", "merge");
+        connect_module("right", "merge");
+        connect_module("merge", DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Parallel stages reorder frames, end restores push order
+class OrderedPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    OrderedPipeline() : leaf::Pipeline<SampleFrame>(64)
+    {
+        add_module<Shuffle>("shuffle", 4);
+        add_module<Shuffle>("again", 4);
+        add_module<Count>("count", 4);
+        connect_module(GraphInputNode(), "shuffle");
+        connect_module("shuffle", "again");
+        connect_module("again", "count");
+        connect_module("count", DataframeEOLNode());
+        order_module(DataframeEOLNode());
+        construct_pipeline();
+    }
+};
+
+// Frames collected into batches of at most 16 before batch module
+class BatchPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    BatchPipeline() : leaf::Pipeline<SampleFrame>(64)
+    {
+        add_module<Increase>("first", 2);
+        add_module<Batch>("batch", 1);
+        add_module<Count>("count", 1);
+        connect_module(GraphInputNode(), "first");
+        connect_module("first", "batch");
+        connect_module("batch", "count");
+        connect_module("count", DataframeEOLNode());
+        batch_module("batch", 16, std::chrono::microseconds(100));
+        construct_pipeline();
+    }
+};
+
+// Second module runs inside node of first one, count inside node of second
+class FusedPipeline : public leaf::Pipeline<SampleFrame>
+{
+public:
+    FusedPipeline() : leaf::Pipeline<SampleFrame>(64)
+    {
+        add_module<Increase>("first", 2);
+        add_module<Increase>("second", 2);
+        add_module<Count>("count", 2);
+        connect_module(GraphInputNode(), "first");
+        connect_module("first", "second");
+        connect_module("second", "count");
+        connect_module("count", DataframeEOLNode());
+        fuse_module("first", "second");
+        fuse_module("second", "count");
+        construct_pipeline();
+    }
+};
+
+template <class _PipelineT>
+bool run()
+{
+    Checks::Get().reset();
+    {
+        _PipelineT pipeline;
+        push(pipeline);
+    }
+    return delivered();
+}
+
+int main()
+{
+    bool success = true;
+
+    // ------------------------
+    std::cout << "Blocking admission, default threads \n";
+
+    success &= run<BlockPipeline>();
+
+    // ------------------------
+    std::cout << "Blocking admission, no worker threads \n";
+    {
+        // Producer runs frames itself while waiting for capacity
+        tbb::global_control control(tbb::global_control::max_allowed_parallelism, 1);
+        success &= run<BlockPipeline>();
+    }
+
+    // ------------------------
+    std::cout << "Fan-out and join \n";
+
+    success &= run<DiamondPipeline>();
+
+    // ------------------------
+    std::cout << "Ordered end after parallel stages \n";
+
+    bool ordered = run<OrderedPipeline>();
+    for (int64_t i = 0; ordered && i < Frames; i++)
+    {
+        ordered = Checks::Get().released[i] == i;
+    }
+    std::cout << "released in push order: " << (ordered ? "yes" : "no") << " \n";
+    success &= ordered;
+
+    // ------------------------
+    std::cout << "Batched module \n";
+
+    bool batched = run<BatchPipeline>() && Checks::Get().max_batch <= 16;
+    std::cout << Checks::Get().batches << " batches, largest " << Checks::Get().max_batch << " \n";
+    success &= batched;
+
+    // ------------------------
+    std::cout << "Fused modules \n";
+
+    success &= run<FusedPipeline>();
+
+    return success ? 0 : 1;
+}
@@ -25,13 +25,38 @@
 #ifndef _LEAF_DAEMON_H_
 #define _LEAF_DAEMON_H_
 
+#include <map>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <functional>
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#include <tbb/task_group.h>
 #include <tbb/concurrent_vector.h>
 #include <tbb/concurrent_unordered_map.h>
 
 namespace leaf {
 
+// Time daemon took to start and stop in ms, 0 if not yet done
+struct DaemonTiming
+{
+    int32_t key;
+    std::string name;
+    double start;
+    double stop;
+};
+
 class Daemon
 {
 public:
@@ -43,11 +68,53 @@ public:
         return dynamic_cast<_DmnT &>(*Register()[key]);
     }
 
+    // Daemon starts after the previously initialized daemon and stops before it,
+    // so daemons without listed dependencies keep serial initialize order
     template <class _DmnT>
     static void Initialize(int32_t key, _DmnT *obj)
+    {
+        std::vector<int32_t> dependencies;
+
+        if (!Indexer().empty())
+        {
+            dependencies.push_back(Indexer().back());
+        }
+        Initialize(key, obj, dependencies);
+    }
+
+    // Daemon starts after daemons it depends on started and stops before they stop,
+    // daemons not depending on each other start and stop concurrently
+    template <class _DmnT>
+    static void Initialize(int32_t key, _DmnT *obj, std::vector<int32_t> dependencies)
     {
         Indexer().push_back(key);
         Register()[key].reset(obj);
+        Dependency()[key] = dependencies;
+    }
+
+    // Timing of last start and stop in initialize order, kept after terminate
+    static std::vector<DaemonTiming> GetTiming()
+    {
+        return Timing();
+    }
+
+    static void PrintTiming()
+    {
+        std::vector<DaemonTiming> &timing = Timing();
+
+        if (timing.empty())
+        {
+            return;
+        }
+
+        printf("=========================== Daemon Timing (ms) ===============================\n");
+        printf("Key   Name   Start   Stop\n");
+        printf("------------------------------------------------------------------------------\n");
+        for (auto &daemon : timing)
+        {
+            printf("%d  %s  %.4f  %.4f\n", daemon.key, daemon.name.c_str(), daemon.start, daemon.stop);
+        }
+        printf("=========================== Daemon Timing (ms) ===============================\n");
     }
 
 protected:
@@ -69,26 +136,192 @@ private:
         return reg;
     }
 
+    static tbb::concurrent_unordered_map<int32_t, std::vector<int32_t>> &Dependency()
+    {
+        static tbb::concurrent_unordered_map<int32_t, std::vector<int32_t>> dep;
+        return dep;
+    }
+
+    static std::vector<DaemonTiming> &Timing()
+    {
+        static std::vector<DaemonTiming> timing;
+        return timing;
+    }
+
     static void Terminate()
     {
         Register().clear();
+        Dependency().clear();
         Indexer().clear();
     }
 
     static void Start()
     {
-        for (auto iter = Indexer().begin(); iter != Indexer().end(); iter++)
+        Schedule(true);
+    }
+
+    static void Stop()
+    {
+        Schedule(false);
+    }
+
+    // Run start or stop of every daemon once all daemons it waits for are done, stop
+    // waits in reverse dependency order. Dependency cycle falls back to serial order.
+    static void Schedule(bool starting)
+    {
+        std::vector<int32_t> keys(Indexer().begin(), Indexer().end());
+        std::map<int32_t, size_t> index;
+        std::vector<DaemonTiming> &timing = Timing();
+
+        // Fresh timing on start, also on stop without matching start
+        if (starting || timing.size() != keys.size())
         {
-            Register().at(*iter)->start();
+            timing.clear();
+
+            for (auto key : keys)
+            {
+                timing.push_back({key, Name(*Register().at(key)), 0, 0});
+            }
         }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            index[keys[i]] = i;
+        }
+
+        // Daemons waiting for each daemon, and count of daemons each one waits for
+        std::vector<std::vector<size_t>> waiters(keys.size());
+        std::unique_ptr<std::atomic<size_t>[]> waiting(new std::atomic<size_t>[keys.size()]);
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            waiting[i] = 0;
+        }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            for (auto key : Dependency()[keys[i]])
+            {
+                auto dep = index.find(key);
+
+                if (dep == index.end() || dep->second == i)
+                {
+                    continue;
+                }
+
+                size_t from = starting ? dep->second : i;
+                size_t to = starting ? i : dep->second;
+
+                waiters[from].push_back(to);
+                waiting[to]++;
+            }
+        }
+
+        if (!Acyclic(waiters))
+        {
+            fprintf(stderr, "Daemon: dependency cycle, %s serially\n", starting ? "start" : "stop");
+
+            for (size_t n = 0; n < keys.size(); n++)
+            {
+                Run(starting ? n : keys.size() - 1 - n, starting);
+            }
+            return;
+        }
+
+        tbb::task_group group;
+        std::function<void(size_t)> launch = [&](size_t i) {
+            group.run([&, i]() {
+                Run(i, starting);
+
+                for (auto next : waiters[i])
+                {
+                    if (--waiting[next] == 0)
+                    {
+                        launch(next);
+                    }
+                }
+            });
+        };
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (waiting[i] == 0)
+            {
+                launch(i);
+            }
+        }
+
+        group.wait();
     }
 
-    static void Stop()
+    // Start or stop daemon of initialize index and time it
+    static void Run(size_t i, bool starting)
+    {
+        Daemon &daemon = *Register().at(Indexer()[i]);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        if (starting)
+        {
+            daemon.start();
+        }
+        else
+        {
+            daemon.stop();
+        }
+
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        (starting ? Timing()[i].start : Timing()[i].stop) = elapsed;
+    }
+
+    static bool Acyclic(const std::vector<std::vector<size_t>> &waiters)
     {
-        for (auto iter = Indexer().rbegin(); iter != Indexer().rend(); iter++)
+        std::vector<size_t> in_degree(waiters.size(), 0);
+        std::vector<size_t> sorted;
+
+        for (auto &next : waiters)
+        {
+            for (auto i : next)
+            {
+                in_degree[i]++;
+            }
+        }
+
+        for (size_t i = 0; i < waiters.size(); i++)
+        {
+            if (in_degree[i] == 0)
+            {
+                sorted.push_back(i);
+            }
+        }
+
+        for (size_t n = 0; n < sorted.size(); n++)
+        {
+            for (auto i : waiters[sorted[n]])
+            {
+                if (--in_degree[i] == 0)
+                {
+                    sorted.push_back(i);
+                }
+            }
+        }
+        return sorted.size() == waiters.size();
+    }
+
+    static std::string Name(Daemon &daemon)
+    {
+        const char *name = typeid(daemon).name();
+        std::string result = name;
+#ifdef __GNUG__
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+
+        if (status == 0 && demangled != nullptr)
         {
-            Register().at(*iter)->stop();
+            result = demangled;
         }
+        free(demangled);
+#endif
+        return result;
     }
 };
 
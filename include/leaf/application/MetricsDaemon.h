@@ -0,0 +1,230 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_METRICS_DAEMON_H_
+#define _LEAF_METRICS_DAEMON_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "Daemon.h"
+#include "../pipeline/Metrics.h"
+
+namespace leaf {
+
+// Daemon exposing metrics in Prometheus text format, either served over HTTP on
+// localhost or written to a file on a timer for node exporter textfile collector.
+class MetricsDaemon : public Daemon
+{
+public:
+    // Serve GET /metrics on 127.0.0.1:port
+    MetricsDaemon(uint16_t port)
+        : _port(port), _interval(std::chrono::milliseconds(200)), _listen_fd(-1), _stop(true)
+    {
+    }
+
+    // Write metrics to path every interval, replaced atomically by rename
+    MetricsDaemon(std::string path, std::chrono::milliseconds interval)
+        : _port(0), _path(path), _interval(interval), _listen_fd(-1), _stop(true)
+    {
+    }
+
+    ~MetricsDaemon()
+    {
+        stop();
+    }
+
+protected:
+    void start() override
+    {
+        if (!_stop)
+        {
+            return;
+        }
+
+        if (_path.empty() && !listen())
+        {
+            fprintf(stderr, "MetricsDaemon: failed to listen on 127.0.0.1:%u\n", _port);
+            return;
+        }
+
+        _stop = false;
+        _thread = std::thread([this]() {
+            while (!_stop)
+            {
+                if (_path.empty())
+                {
+                    serve();
+                }
+                else
+                {
+                    write();
+                    std::this_thread::sleep_for(_interval);
+                }
+            }
+        });
+    }
+
+    void stop() override
+    {
+        _stop = true;
+
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+
+        if (_listen_fd >= 0)
+        {
+            close(_listen_fd);
+            _listen_fd = -1;
+        }
+    }
+
+private:
+    bool listen()
+    {
+        sockaddr_in addr;
+        int reuse = 1;
+
+        _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (_listen_fd < 0)
+        {
+            return false;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        if (bind(_listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(_listen_fd, 8) != 0)
+        {
+            close(_listen_fd);
+            _listen_fd = -1;
+            return false;
+        }
+        return true;
+    }
+
+    // Answer one connection, poll times out so stop is noticed
+    void serve()
+    {
+        pollfd pfd = {_listen_fd, POLLIN, 0};
+
+        if (poll(&pfd, 1, (int)_interval.count()) <= 0)
+        {
+            return;
+        }
+
+        int fd = accept(_listen_fd, nullptr, nullptr);
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        // Silent or stalled client must not hold serve thread and stop
+        timeval timeout = {ClientTimeout / 1000, (ClientTimeout % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        char request[1024];
+        ssize_t size = recv(fd, request, sizeof(request) - 1, 0);
+        std::string response;
+
+        if (size > 0 && (request[size] = '\0', strncmp(request, "GET /metrics", 12) == 0))
+        {
+            std::string body = Metrics::Expose();
+
+            response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                       std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        }
+        else
+        {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+
+        for (size_t sent = 0; sent < response.size();)
+        {
+            ssize_t count = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+
+            if (count <= 0)
+            {
+                break;
+            }
+            sent += count;
+        }
+
+        close(fd);
+    }
+
+    void write()
+    {
+        std::string body = Metrics::Expose();
+        std::string temp = _path + ".tmp";
+        FILE *file = fopen(temp.c_str(), "w");
+
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        bool written = fwrite(body.data(), 1, body.size(), file) == body.size();
+
+        if (fclose(file) == 0 && written)
+        {
+            rename(temp.c_str(), _path.c_str());
+        }
+    }
+
+    // Time in ms a client may take to send request or receive response
+    static const int32_t ClientTimeout = 1000;
+
+    uint16_t _port;
+    std::string _path;
+    std::chrono::milliseconds _interval;
+
+    int _listen_fd;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_METRICS_DAEMON_H_ */
@@ -25,17 +25,87 @@
 #ifndef _LEAF_BUFFER_H_
 #define _LEAF_BUFFER_H_
 
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <utility>
+
+#include <stddef.h>
+
 #include <tbb/concurrent_queue.h>
 
+#include "RingQueue.h"
+#include "EventCount.h"
+
 namespace leaf {
 
-template <class _FrameT>
+// Queue policy backed by tbb::concurrent_bounded_queue
+template <typename _TypeT>
+class TBBQueue
+{
+public:
+    static const bool MultiProducer = true;
+    static const bool MultiConsumer = true;
+
+    TBBQueue(size_t capacity) : _capacity(capacity)
+    {
+        _queue.set_capacity(capacity);
+    }
+
+    // Move value into queue, value is untouched if queue is full
+    bool try_push(_TypeT &val)
+    {
+        return _queue.try_push(std::move(val));
+    }
+
+    bool try_pop(_TypeT &val)
+    {
+        return _queue.try_pop(val);
+    }
+
+    size_t size()
+    {
+        ptrdiff_t size = _queue.size();
+        return size > 0 ? size : 0;
+    }
+
+    size_t capacity()
+    {
+        return _capacity;
+    }
+
+private:
+    size_t _capacity;
+    tbb::concurrent_bounded_queue<_TypeT> _queue;
+};
+
+// What a full buffer does with a new frame
+enum class DropPolicy
+{
+    Reject,     // New frame is refused, try_push fails
+    DropOldest, // Oldest frame is disposed to make room
+    KeepLatest  // Only latest N frames are kept, older ones are disposed
+};
+
+struct BufferStatistic
+{
+    size_t rejected; // Pushes failed for good, try_push refused or push_wait timed out
+    size_t evicted;  // Old frames disposed under DropOldest or KeepLatest
+    size_t size;     // Frames held when taken
+    size_t capacity;
+};
+
+// Queue policy _QueueT is TBBQueue, SPSCRing for one source thread feeding one
+// consumer, or MPMCRing. Frames are moved in and out of the queue.
+template <class _FrameT, class _QueueT = TBBQueue<typename _FrameT::ptr>>
 class Buffer
 {
 public:
-    Buffer(size_t capacity) : _capacity(capacity)
+    Buffer(size_t capacity)
+        : _capacity(capacity), _buffer(capacity),
+          _drop_policy(DropPolicy::Reject), _keep_latest(capacity), _rejected(0), _evicted(0)
     {
-        _buffer.set_capacity(_capacity);
     }
 
     virtual ~Buffer()
@@ -56,15 +126,130 @@ public:
 
     virtual bool source_active() = 0;
 
+    // Set before frames flow. Eviction pops from producer side, so it needs a
+    // multi consumer queue. keep_latest is only used by KeepLatest.
+    bool set_drop_policy(DropPolicy policy, size_t keep_latest = 0)
+    {
+        if (policy != DropPolicy::Reject && !_QueueT::MultiConsumer)
+        {
+            return false;
+        }
+
+        if (policy == DropPolicy::KeepLatest && (keep_latest == 0 || keep_latest > _capacity))
+        {
+            return false;
+        }
+
+        _drop_policy = policy;
+        _keep_latest = policy == DropPolicy::KeepLatest ? keep_latest : _capacity;
+        return true;
+    }
+
+    DropPolicy drop_policy()
+    {
+        return _drop_policy;
+    }
+
+    BufferStatistic statistic()
+    {
+        BufferStatistic stat;
+        stat.rejected = _rejected.load(std::memory_order_relaxed);
+        stat.evicted = _evicted.load(std::memory_order_relaxed);
+        stat.size = _buffer.size();
+        stat.capacity = _capacity;
+        return stat;
+    }
+
+    void reset_statistic()
+    {
+        _rejected.store(0, std::memory_order_relaxed);
+        _evicted.store(0, std::memory_order_relaxed);
+    }
+
+    // Pop frame from buffer, wait at most timeout, nullptr if none arrived
+    virtual typename _FrameT::ptr pop_frame_wait(std::chrono::microseconds timeout)
+    {
+        typename _FrameT::ptr frame;
+
+        _not_empty.wait_until([&]() { return try_pop(frame); }, std::chrono::steady_clock::now() + timeout);
+
+        return frame;
+    }
+
+    // Append up to max_n frames to out with one wake up of producers, wait at most
+    // timeout for the first one. Returns number of frames popped.
+    virtual size_t pop_batch(std::vector<typename _FrameT::ptr> &out, size_t max_n,
+                             std::chrono::microseconds timeout = std::chrono::microseconds(0))
+    {
+        typename _FrameT::ptr frame;
+        size_t count = 0;
+
+        if (max_n == 0 || !_not_empty.wait_until([&]() { return _buffer.try_pop(frame); },
+                                                 std::chrono::steady_clock::now() + timeout))
+        {
+            return 0;
+        }
+
+        do
+        {
+            out.push_back(std::move(frame));
+            count++;
+        } while (count < max_n && _buffer.try_pop(frame));
+
+        _not_full.notify_all();
+        return count;
+    }
+
 protected:
+    // Frame is moved into buffer on success, full buffer follows drop policy
     bool try_push(typename _FrameT::ptr &frame)
     {
-        return _buffer.try_push(frame);
+        if (push_notify(frame))
+        {
+            return true;
+        }
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
     bool try_pop(typename _FrameT::ptr &frame)
     {
-        return _buffer.try_pop(frame);
+        if (_buffer.try_pop(frame))
+        {
+            _not_full.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    // Push frame into buffer, wait at most timeout for free space
+    bool push_wait(typename _FrameT::ptr &frame, std::chrono::microseconds timeout)
+    {
+        if (_not_full.wait_until([&]() { return push_notify(frame); }, std::chrono::steady_clock::now() + timeout))
+        {
+            return true;
+        }
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Push frames in order with one wake up of consumers, until buffer is full.
+    // Pushed frames are moved from, returns number of frames pushed. Frames left to
+    // caller are not counted as rejected.
+    size_t push_batch(std::vector<typename _FrameT::ptr> &frames)
+    {
+        size_t count = 0;
+
+        while (count < frames.size() && push_one(frames[count]))
+        {
+            count++;
+        }
+
+        if (count > 0)
+        {
+            _not_empty.notify_all();
+        }
+        return count;
     }
 
     size_t size()
@@ -83,8 +268,71 @@ protected:
     }
 
 private:
+    bool push_notify(typename _FrameT::ptr &frame)
+    {
+        if (push_one(frame))
+        {
+            _not_empty.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    // Push one frame following drop policy, failed attempt is counted by caller
+    bool push_one(typename _FrameT::ptr &frame)
+    {
+        if (_drop_policy == DropPolicy::Reject)
+        {
+            return _buffer.try_push(frame);
+        }
+
+        // Trim down to latest N, leaving room for the new frame
+        while (_buffer.size() >= _keep_latest && evict_oldest())
+        {
+        }
+
+        // Other producers may take the freed room, bounded retry
+        for (size_t i = 0; i <= _capacity; i++)
+        {
+            if (_buffer.try_push(frame))
+            {
+                return true;
+            }
+            if (!evict_oldest())
+            {
+                // Slot held by a preempted producer or consumer
+                std::this_thread::yield();
+            }
+        }
+        return false;
+    }
+
+    bool evict_oldest()
+    {
+        typename _FrameT::ptr frame;
+
+        if (!_buffer.try_pop(frame))
+        {
+            return false;
+        }
+
+        _FrameT::Dispose(frame);
+        _evicted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
     size_t _capacity;
-    tbb::concurrent_bounded_queue<typename _FrameT::ptr> _buffer;
+    _QueueT _buffer;
+
+    DropPolicy _drop_policy;
+    size_t _keep_latest;
+
+    std::atomic<size_t> _rejected;
+    std::atomic<size_t> _evicted;
+
+    // Wake up consumers waiting for frames and producers waiting for space
+    EventCount _not_empty;
+    EventCount _not_full;
 };
 
 } // namespace leaf
@@ -0,0 +1,157 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_EVENT_COUNT_H_
+#define _LEAF_EVENT_COUNT_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+#include <stdint.h>
+
+namespace leaf {
+
+// Wait for a condition with a short adaptive spin, then sleep on a condition variable
+// (futex on Linux). Notifier only pays a fence and a load while nobody sleeps.
+// Condition is always evaluated outside the lock, waiter registers first and sleeps
+// only if no notify happened since, so pred may notify other event counts.
+class EventCount
+{
+public:
+    EventCount() : _waiters(0), _epoch(0), _spin(MinSpin) {}
+
+    // Wait until pred() is true or deadline passed, returns pred()
+    template <typename _PredT>
+    bool wait_until(_PredT pred, std::chrono::steady_clock::time_point deadline)
+    {
+        int32_t spin = _spin.load(std::memory_order_relaxed);
+
+        for (int32_t i = 0; i < spin; i++)
+        {
+            if (pred())
+            {
+                // Spinning paid off, allow longer spin next time
+                _spin.store(spin * 2 < MaxSpin ? spin * 2 : MaxSpin, std::memory_order_relaxed);
+                return true;
+            }
+            Relax();
+        }
+
+        // Spinning wasted, shorten it next time
+        _spin.store(spin / 2 > MinSpin ? spin / 2 : MinSpin, std::memory_order_relaxed);
+
+        while (true)
+        {
+            uint64_t epoch = prepare_wait();
+
+            if (pred())
+            {
+                cancel_wait();
+                return true;
+            }
+
+            if (!commit_wait(epoch, deadline))
+            {
+                return pred();
+            }
+        }
+    }
+
+    // Call after making condition true
+    void notify_all()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (_waiters.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _epoch.fetch_add(1, std::memory_order_relaxed);
+            _cond.notify_all();
+        }
+    }
+
+private:
+    static const int32_t MinSpin = 16;
+    static const int32_t MaxSpin = 4096;
+
+    static void Relax()
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #else
+        std::this_thread::yield();
+        #endif
+    }
+
+    // Register waiter before checking condition, returns epoch to sleep on
+    uint64_t prepare_wait()
+    {
+        _waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _epoch.load(std::memory_order_relaxed);
+    }
+
+    void cancel_wait()
+    {
+        _waiters.fetch_sub(1);
+    }
+
+    // Sleep until a notify after epoch, false if deadline passed first
+    bool commit_wait(uint64_t epoch, std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        bool notified = true;
+
+        while (_epoch.load(std::memory_order_relaxed) == epoch)
+        {
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                _cond.wait(lock);
+            }
+            else if (_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                notified = _epoch.load(std::memory_order_relaxed) != epoch;
+                break;
+            }
+        }
+
+        _waiters.fetch_sub(1);
+        return notified;
+    }
+
+    std::atomic<int32_t> _waiters;
+    // Bumped under mutex by every notify seen with waiters
+    std::atomic<uint64_t> _epoch;
+    std::atomic<int32_t> _spin;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_EVENT_COUNT_H_ */
@@ -0,0 +1,247 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_MAPPED_REPLAY_BUFFER_H_
+#define _LEAF_MAPPED_REPLAY_BUFFER_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Buffer.h"
+#include "../frame/MappedFrame.h"
+
+namespace leaf {
+
+// Replay source reading a recorded file through mmap. Frames point straight into
+// the mapping, _FrameT must provide Wrap(owner, record) like MappedFrame.
+// pull_source() is expected to be called from one source thread.
+template <class _FrameT = MappedFrame, class _QueueT = TBBQueue<typename _FrameT::ptr>>
+class MappedReplayBuffer : public Buffer<_FrameT, _QueueT>
+{
+public:
+    MappedReplayBuffer(size_t capacity)
+        : Buffer<_FrameT, _QueueT>(capacity), _cursor(0), _speed(0), _paced(false), _start_stamp(0)
+    {
+    }
+
+    // Map recorded file and index its frames, false if file is missing or malformed.
+    // A truncated last frame is ignored, so files of crashed recordings still replay.
+    bool open(const std::string &path)
+    {
+        std::shared_ptr<Mapping> mapping = Mapping::Open(path);
+
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        _mapping = mapping;
+        rewind();
+        return true;
+    }
+
+    // Mapping is unmapped once frames still in flight are released
+    void close()
+    {
+        _mapping.reset();
+        rewind();
+    }
+
+    // Replay speed, 0 as fast as possible, 1 real time, N for N times real time
+    void set_rate(double speed)
+    {
+        _speed = speed > 0 ? speed : 0;
+        _paced = false;
+    }
+
+    // Restart replay from first frame
+    void rewind()
+    {
+        _cursor = 0;
+        _paced = false;
+    }
+
+    size_t record_count()
+    {
+        return _mapping != nullptr ? _mapping->records.size() : 0;
+    }
+
+    typename _FrameT::ptr pop_frame() override
+    {
+        typename _FrameT::ptr frame;
+
+        this->try_pop(frame);
+        return frame;
+    }
+
+    bool frame_available() override
+    {
+        return this->size() > 0;
+    }
+
+    // Push next recorded frame into buffer, sleep until its replay time first
+    bool pull_source() override
+    {
+        if (!source_active())
+        {
+            return false;
+        }
+
+        MappedRecord &record = _mapping->records[_cursor];
+
+        if (_speed > 0)
+        {
+            pace(record.timestamp);
+        }
+
+        typename _FrameT::ptr frame = _FrameT::Wrap(_mapping, &record);
+
+        if (!this->try_push(frame))
+        {
+            return false;
+        }
+
+        _cursor++;
+        return true;
+    }
+
+    bool source_active() override
+    {
+        return _mapping != nullptr && _cursor < _mapping->records.size();
+    }
+
+private:
+    // Read only mapping of a replay file with index of its frames
+    struct Mapping
+    {
+        Mapping(char *addr, size_t length) : addr(addr), length(length) {}
+
+        ~Mapping()
+        {
+            munmap(addr, length);
+        }
+
+        static std::shared_ptr<Mapping> Open(const std::string &path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+
+            if (fd < 0)
+            {
+                return nullptr;
+            }
+
+            struct stat info;
+
+            if (fstat(fd, &info) != 0 || (size_t)info.st_size < ReplayFormat::MagicSize())
+            {
+                ::close(fd);
+                return nullptr;
+            }
+
+            // Mapping stays valid after fd is closed
+            void *addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+
+            if (addr == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            madvise(addr, info.st_size, MADV_SEQUENTIAL);
+
+            std::shared_ptr<Mapping> mapping = std::make_shared<Mapping>((char *)addr, info.st_size);
+
+            if (memcmp(addr, ReplayFormat::Magic(), ReplayFormat::MagicSize()) != 0)
+            {
+                return nullptr;
+            }
+
+            mapping->index();
+            return mapping;
+        }
+
+        void index()
+        {
+            size_t offset = ReplayFormat::MagicSize();
+
+            while (offset + sizeof(ReplayHeader) <= length)
+            {
+                ReplayHeader header;
+                memcpy(&header, addr + offset, sizeof(header));
+
+                offset += sizeof(ReplayHeader);
+
+                if (header.size > length - offset)
+                {
+                    break;
+                }
+
+                records.push_back({addr + offset, header.size, header.timestamp});
+                offset += ReplayFormat::Padded(header.size);
+            }
+        }
+
+        char *addr;
+        size_t length;
+        std::vector<MappedRecord> records;
+    };
+
+    // Sleep until frame is due, relative to first frame replayed at current rate
+    void pace(uint64_t timestamp)
+    {
+        if (!_paced)
+        {
+            _paced = true;
+            _start_time = std::chrono::steady_clock::now();
+            _start_stamp = timestamp;
+        }
+
+        int64_t elapsed = (int64_t)(timestamp - _start_stamp);
+        std::chrono::nanoseconds offset((int64_t)(elapsed / _speed));
+
+        std::this_thread::sleep_until(_start_time + offset);
+    }
+
+    std::shared_ptr<Mapping> _mapping;
+    size_t _cursor;
+
+    double _speed;
+    bool _paced;
+    uint64_t _start_stamp;
+    std::chrono::steady_clock::time_point _start_time;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_MAPPED_REPLAY_BUFFER_H_ */
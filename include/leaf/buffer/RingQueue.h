@@ -0,0 +1,251 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_RING_QUEUE_H_
+#define _LEAF_RING_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace leaf {
+
+// Bounded lock-free single-producer single-consumer ring
+template <typename _TypeT>
+class SPSCRing
+{
+public:
+    static const bool MultiProducer = false;
+    static const bool MultiConsumer = false;
+
+    SPSCRing(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1), _slots(new _TypeT[_capacity]),
+          _push_pos(0), _pop_cache(0), _pop_pos(0), _push_cache(0)
+    {
+        // Mask index if capacity is power of two, otherwise modulo
+        _mask = (_capacity & (_capacity - 1)) == 0 ? _capacity - 1 : 0;
+    }
+
+    // Move value into ring, value is untouched if ring is full. Producer thread only.
+    bool try_push(_TypeT &val)
+    {
+        size_t pos = _push_pos.load(std::memory_order_relaxed);
+
+        if (pos - _pop_cache == _capacity)
+        {
+            _pop_cache = _pop_pos.load(std::memory_order_acquire);
+
+            if (pos - _pop_cache == _capacity)
+            {
+                return false;
+            }
+        }
+
+        _slots[index(pos)] = std::move(val);
+        _push_pos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Move value out of ring. Consumer thread only.
+    bool try_pop(_TypeT &val)
+    {
+        size_t pos = _pop_pos.load(std::memory_order_relaxed);
+
+        if (pos == _push_cache)
+        {
+            _push_cache = _push_pos.load(std::memory_order_acquire);
+
+            if (pos == _push_cache)
+            {
+                return false;
+            }
+        }
+
+        _TypeT &slot = _slots[index(pos)];
+        val = std::move(slot);
+        slot = _TypeT();
+        _pop_pos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate count, exact when no concurrent push or pop
+    size_t size()
+    {
+        size_t pop = _pop_pos.load(std::memory_order_relaxed);
+        size_t push = _push_pos.load(std::memory_order_relaxed);
+        return push > pop ? push - pop : 0;
+    }
+
+    size_t capacity()
+    {
+        return _capacity;
+    }
+
+private:
+    size_t index(size_t pos)
+    {
+        return _mask ? (pos & _mask) : (pos % _capacity);
+    }
+
+    size_t _capacity;
+    size_t _mask;
+    std::unique_ptr<_TypeT[]> _slots;
+
+    // Producer and consumer state on separate cache lines, each side caches the other position
+    char _pad0[64];
+    std::atomic<size_t> _push_pos;
+    size_t _pop_cache;
+    char _pad1[64];
+    std::atomic<size_t> _pop_pos;
+    size_t _push_cache;
+    char _pad2[64];
+};
+
+// Bounded lock-free multi-producer multi-consumer ring (Dmitry Vyukov)
+template <typename _TypeT>
+class MPMCRing
+{
+public:
+    static const bool MultiProducer = true;
+    static const bool MultiConsumer = true;
+
+    MPMCRing(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1), _cells(new Cell[_capacity]),
+          _push_pos(0), _pop_pos(0)
+    {
+        // Mask index if capacity is power of two, otherwise modulo
+        _mask = (_capacity & (_capacity - 1)) == 0 ? _capacity - 1 : 0;
+
+        for (size_t i = 0; i < _capacity; i++)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Move value into ring, value is untouched if ring is full
+    bool try_push(_TypeT &val)
+    {
+        size_t pos = _push_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell &cell = _cells[index(pos)];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0)
+            {
+                if (_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(val);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _push_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Move value out of ring
+    bool try_pop(_TypeT &val)
+    {
+        size_t pos = _pop_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell &cell = _cells[index(pos)];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (diff == 0)
+            {
+                if (_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    val = std::move(cell.data);
+                    cell.data = _TypeT();
+                    cell.sequence.store(pos + _capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate count, exact when no concurrent push or pop
+    size_t size()
+    {
+        size_t pop = _pop_pos.load(std::memory_order_relaxed);
+        size_t push = _push_pos.load(std::memory_order_relaxed);
+        return push > pop ? push - pop : 0;
+    }
+
+    size_t capacity()
+    {
+        return _capacity;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        _TypeT data;
+    };
+
+    size_t index(size_t pos)
+    {
+        return _mask ? (pos & _mask) : (pos % _capacity);
+    }
+
+    size_t _capacity;
+    size_t _mask;
+    std::unique_ptr<Cell[]> _cells;
+
+    // Keep producer and consumer position on separate cache lines
+    char _pad0[64];
+    std::atomic<size_t> _push_pos;
+    char _pad1[64];
+    std::atomic<size_t> _pop_pos;
+    char _pad2[64];
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_RING_QUEUE_H_ */
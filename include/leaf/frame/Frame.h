@@ -35,6 +35,11 @@ class Frame
 public:
     typedef std::shared_ptr<_DataT> ptr;
 
+    static ptr Create()
+    {
+        return std::make_shared<_DataT>();
+    }
+
     static void Dispose(ptr &d)
     {
         d.reset();
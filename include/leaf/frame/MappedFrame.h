@@ -0,0 +1,107 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_MAPPED_FRAME_H_
+#define _LEAF_MAPPED_FRAME_H_
+
+#include <memory>
+
+#include <stdint.h>
+
+namespace leaf {
+
+// Replay file layout, native byte order:
+//   magic "LEAFREC1"
+//   repeated { ReplayHeader, payload padded to 8 bytes }
+// Payloads stay 8 byte aligned in a mapping, so they can be read in place.
+struct ReplayHeader
+{
+    uint32_t size;      // Payload size in bytes, without padding
+    uint32_t reserved;
+    uint64_t timestamp; // Capture time in ns, only differences matter
+};
+
+struct ReplayFormat
+{
+    static const char *Magic()
+    {
+        return "LEAFREC1";
+    }
+
+    static size_t MagicSize()
+    {
+        return 8;
+    }
+
+    static size_t Padded(size_t size)
+    {
+        return (size + 7) & ~(size_t)7;
+    }
+};
+
+// One recorded frame, data points into replay mapping
+struct MappedRecord
+{
+    const char *data;
+    uint32_t size;
+    uint64_t timestamp;
+
+    // View payload as recorded trivially copyable object
+    template <typename _TypeT>
+    const _TypeT *as() const
+    {
+        return size >= sizeof(_TypeT) ? reinterpret_cast<const _TypeT *>(data) : nullptr;
+    }
+};
+
+// Frame policy of replayed frames. Frames share ownership of the mapping they
+// point into, so mapping outlives every frame handed out.
+class MappedFrame
+{
+public:
+    typedef std::shared_ptr<MappedRecord> ptr;
+
+    // Frame without mapping, data is null
+    static ptr Create()
+    {
+        return std::make_shared<MappedRecord>();
+    }
+
+    // Frame aliasing owner, no allocation and no copy. Record is shared by
+    // every replay of it, modules should treat it as read only.
+    template <typename _OwnerT>
+    static ptr Wrap(const std::shared_ptr<_OwnerT> &owner, MappedRecord *record)
+    {
+        return ptr(owner, record);
+    }
+
+    static void Dispose(ptr &d)
+    {
+        d.reset();
+    }
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_MAPPED_FRAME_H_ */
@@ -0,0 +1,201 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_POOLED_FRAME_H_
+#define _LEAF_POOLED_FRAME_H_
+
+#include <new>
+#include <atomic>
+#include <memory>
+
+#include <stdint.h>
+
+#include "../buffer/RingQueue.h"
+
+namespace leaf {
+
+struct FramePoolStatistic
+{
+    int64_t hit;
+    int64_t miss;
+    int64_t recycle;
+    int64_t discard;
+    int64_t idle;
+};
+
+// Frame policy recycling data objects and shared_ptr control blocks through bounded
+// lock-free free-lists. Recycled data keeps previous content, modules must overwrite it.
+template <class _DataT>
+class PooledFrame
+{
+public:
+    typedef std::shared_ptr<_DataT> ptr;
+
+    // Max idle frames kept in pool, must be set before first frame is created
+    static size_t &PoolCapacity()
+    {
+        static size_t pool_capacity = 64;
+        return pool_capacity;
+    }
+
+    static ptr Create()
+    {
+        FramePool &pool = Pool();
+        _DataT *data = nullptr;
+
+        if (pool.frames.try_pop(data))
+        {
+            pool.hit.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            pool.miss.fetch_add(1, std::memory_order_relaxed);
+            data = new _DataT();
+        }
+
+        return ptr(data, Recycler(), BlockAllocator<_DataT>());
+    }
+
+    // Data goes back to pool once the last reference is released
+    static void Dispose(ptr &d)
+    {
+        d.reset();
+    }
+
+    static FramePoolStatistic GetStatistic()
+    {
+        FramePool &pool = Pool();
+
+        return {pool.hit.load(std::memory_order_relaxed),
+                pool.miss.load(std::memory_order_relaxed),
+                pool.recycle.load(std::memory_order_relaxed),
+                pool.discard.load(std::memory_order_relaxed),
+                (int64_t)pool.frames.size()};
+    }
+
+    // Release idle frames held by pool
+    static void Clear()
+    {
+        _DataT *data = nullptr;
+
+        while (Pool().frames.try_pop(data))
+        {
+            delete data;
+        }
+    }
+
+private:
+    struct FramePool
+    {
+        FramePool(size_t capacity) : frames(capacity), hit(0), miss(0), recycle(0), discard(0) {}
+
+        MPMCRing<_DataT *> frames;
+
+        std::atomic<int64_t> hit;
+        std::atomic<int64_t> miss;
+        std::atomic<int64_t> recycle;
+        std::atomic<int64_t> discard;
+    };
+
+    // Pool is never destroyed, frames may be released after static destruction
+    static FramePool &Pool()
+    {
+        static FramePool *pool = new FramePool(PoolCapacity());
+        return *pool;
+    }
+
+    // Deleter of pooled frame, return data into pool
+    struct Recycler
+    {
+        void operator()(_DataT *data) const
+        {
+            FramePool &pool = Pool();
+
+            if (pool.frames.try_push(data))
+            {
+                pool.recycle.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                pool.discard.fetch_add(1, std::memory_order_relaxed);
+                delete data;
+            }
+        }
+    };
+
+    // Allocator of shared_ptr control block, reuse blocks of same size
+    template <typename _TypeT>
+    struct BlockAllocator
+    {
+        typedef _TypeT value_type;
+
+        BlockAllocator() = default;
+
+        template <typename _OtherT>
+        BlockAllocator(const BlockAllocator<_OtherT> &) {}
+
+        _TypeT *allocate(size_t n)
+        {
+            void *block = nullptr;
+
+            if (n != 1 || !Blocks().try_pop(block))
+            {
+                block = ::operator new(n * sizeof(_TypeT));
+            }
+            return static_cast<_TypeT *>(block);
+        }
+
+        void deallocate(_TypeT *p, size_t n)
+        {
+            void *block = p;
+
+            if (n != 1 || !Blocks().try_push(block))
+            {
+                ::operator delete(block);
+            }
+        }
+
+        static MPMCRing<void *> &Blocks()
+        {
+            static MPMCRing<void *> *blocks = new MPMCRing<void *>(PoolCapacity());
+            return *blocks;
+        }
+
+        template <typename _OtherT>
+        bool operator==(const BlockAllocator<_OtherT> &) const
+        {
+            return true;
+        }
+
+        template <typename _OtherT>
+        bool operator!=(const BlockAllocator<_OtherT> &) const
+        {
+            return false;
+        }
+    };
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_POOLED_FRAME_H_ */
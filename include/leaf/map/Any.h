@@ -25,55 +25,131 @@
 #ifndef _LEAF_ANY_H_
 #define _LEAF_ANY_H_
 
-#include <memory>
+#include <new>
+#include <utility>
+#include <typeinfo>
+#include <type_traits>
+
+#include <string.h>
 
 namespace leaf
 {
 
+// Type erased value with inline storage for small trivially copyable types.
+// Copy is deep: unlike the previous shared_ptr content, a copied Any owns its own
+// value and writes through one are not seen by the other. Share state explicitly
+// by storing a pointer, as map handles do with their cells.
 class Any
 {
 public:
     // Constructor
-    Any() = default;
+    Any() : _ops(nullptr) {}
+
+    // Copy content value, not shared with other
+    Any(const Any &other) : _ops(nullptr)
+    {
+        copy_from(other);
+    }
+
+    Any(Any &&other) : _ops(nullptr)
+    {
+        move_from(other);
+    }
 
     // Template constructor
-    template <typename _TypeT>
-    Any(const _TypeT &val)
+    template <typename _TypeT, typename = typename std::enable_if<!std::is_same<typename std::decay<_TypeT>::type, Any>::value>::type>
+    Any(_TypeT &&val) : _ops(nullptr)
+    {
+        emplace<typename std::decay<_TypeT>::type>(std::forward<_TypeT>(val));
+    }
+
+    ~Any()
+    {
+        clear();
+    }
+
+    Any &operator=(const Any &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    Any &operator=(Any &&other)
     {
-        reset<_TypeT>(val);
+        if (this != &other)
+        {
+            clear();
+            move_from(other);
+        }
+        return *this;
     }
 
     // Content empty
-    bool empty()
+    bool empty() const
     {
-        return !_content;
+        return _ops == nullptr;
     }
 
     // Clear content
     void clear()
     {
-        _content.reset();
+        if (_ops)
+        {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+    // Check content type
+    template <typename _TypeT>
+    bool is() const
+    {
+        return _ops == &Operations<_TypeT>::Table();
     }
 
     // Template reset content
     template <typename _TypeT>
     void reset()
     {
-        _content.reset(new AnyType<_TypeT>);
+        emplace<_TypeT>();
     }
 
     // Template reset content with value
     template <typename _TypeT>
     void reset(const _TypeT &val)
     {
-        _content.reset(new AnyType<_TypeT>(val));
+        emplace<_TypeT>(val);
+    }
+
+    // Template construct content in place
+    template <typename _TypeT, typename... _ArgsT>
+    _TypeT &emplace(_ArgsT &&... args)
+    {
+        clear();
+        Operations<_TypeT>::Create(_storage, std::forward<_ArgsT>(args)...);
+        _ops = &Operations<_TypeT>::Table();
+        return *Operations<_TypeT>::Get(_storage);
     }
 
     // Template operator =
-    template <typename _TypeT>
-    Any &operator=(const _TypeT &val)
+    template <typename _TypeT, typename = typename std::enable_if<!std::is_same<typename std::decay<_TypeT>::type, Any>::value>::type>
+    Any &operator=(_TypeT &&val)
     {
-        reset<_TypeT>(val);
+        typedef typename std::decay<_TypeT>::type value_type;
+
+        // Assign in place when type unchanged
+        if (is<value_type>())
+        {
+            *Operations<value_type>::Get(_storage) = std::forward<_TypeT>(val);
+        }
+        else
+        {
+            emplace<value_type>(std::forward<_TypeT>(val));
+        }
         return *this;
     }
 
@@ -84,52 +160,154 @@ public:
         return Cast<_TypeT>(*this);
     }
 
-    // Template cast to _TypeT
+    // Template cast to _TypeT, content reset to default _TypeT if type mismatch
     template <typename _TypeT>
     static _TypeT &Cast(Any &any)
     {
-        auto ptr = std::dynamic_pointer_cast<AnyType<_TypeT>>(any._content);
-
-        if (!ptr)
+        if (!any.is<_TypeT>())
         {
-            any.reset<_TypeT>();
+            return any.emplace<_TypeT>();
         }
 
-        return ptr -> data;
+        return *Operations<_TypeT>::Get(any._storage);
     }
 
     // Template cast to _TypeT const
     template <typename _TypeT>
     static _TypeT &Cast(const Any &any)
     {
-        auto ptr = std::dynamic_pointer_cast<AnyType<_TypeT>>(any._content);
-
-        if (!ptr)
+        if (!any.is<_TypeT>())
         {
             throw std::bad_cast();
         }
 
-        return ptr -> data;
+        return *Operations<_TypeT>::Get(const_cast<Storage &>(any._storage));
     }
 
 private:
-    // Base for pointer
-    struct AnyTypeBase
+    // Inline buffer for small trivially copyable types, pointer for others
+    union Storage
+    {
+        void *pointer;
+        typename std::aligned_storage<16, alignof(double)>::type buffer;
+    };
+
+    // Type erased operations, address of table is type tag
+    struct OperationTable
+    {
+        void (*copy)(Storage &dst, const Storage &src);
+        void (*move)(Storage &dst, Storage &src);
+        void (*destroy)(Storage &self);
+    };
+
+    template <typename _TypeT>
+    struct IsInline
+    {
+        static const bool value = sizeof(_TypeT) <= sizeof(Storage) &&
+                                  alignof(Storage) % alignof(_TypeT) == 0 &&
+                                  std::is_trivially_copyable<_TypeT>::value;
+    };
+
+    template <typename _TypeT, bool _InlineT = IsInline<_TypeT>::value>
+    struct Operations;
+
+    // Stored in inline buffer
+    template <typename _TypeT>
+    struct Operations<_TypeT, true>
     {
-        virtual ~AnyTypeBase() = default;
+        template <typename... _ArgsT>
+        static void Create(Storage &self, _ArgsT &&... args)
+        {
+            new (&self.buffer) _TypeT(std::forward<_ArgsT>(args)...);
+        }
+
+        static _TypeT *Get(Storage &self)
+        {
+            return reinterpret_cast<_TypeT *>(&self.buffer);
+        }
+
+        static void Copy(Storage &dst, const Storage &src)
+        {
+            memcpy(&dst.buffer, &src.buffer, sizeof(_TypeT));
+        }
+
+        static void Move(Storage &dst, Storage &src)
+        {
+            memcpy(&dst.buffer, &src.buffer, sizeof(_TypeT));
+        }
+
+        static void Destroy(Storage &)
+        {
+        }
+
+        static const OperationTable &Table()
+        {
+            static const OperationTable table = {Copy, Move, Destroy};
+            return table;
+        }
     };
 
-    // Store actual data
+    // Stored on heap
     template <typename _TypeT>
-    struct AnyType : public AnyTypeBase
+    struct Operations<_TypeT, false>
     {
-        _TypeT data;
-        AnyType() = default;
-        explicit AnyType(const _TypeT &d) : data(d) {}
+        template <typename... _ArgsT>
+        static void Create(Storage &self, _ArgsT &&... args)
+        {
+            self.pointer = new _TypeT(std::forward<_ArgsT>(args)...);
+        }
+
+        static _TypeT *Get(Storage &self)
+        {
+            return static_cast<_TypeT *>(self.pointer);
+        }
+
+        static void Copy(Storage &dst, const Storage &src)
+        {
+            dst.pointer = new _TypeT(*static_cast<const _TypeT *>(src.pointer));
+        }
+
+        static void Move(Storage &dst, Storage &src)
+        {
+            dst.pointer = src.pointer;
+            src.pointer = nullptr;
+        }
+
+        static void Destroy(Storage &self)
+        {
+            delete static_cast<_TypeT *>(self.pointer);
+        }
+
+        static const OperationTable &Table()
+        {
+            static const OperationTable table = {Copy, Move, Destroy};
+            return table;
+        }
     };
 
-    // Pointer to base
-    std::shared_ptr<AnyTypeBase> _content;
+    void copy_from(const Any &other)
+    {
+        if (other._ops)
+        {
+            other._ops->copy(_storage, other._storage);
+            _ops = other._ops;
+        }
+    }
+
+    void move_from(Any &other)
+    {
+        if (other._ops)
+        {
+            other._ops->move(_storage, other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    // Operations of content type, null if empty
+    const OperationTable *_ops;
+    // Content
+    Storage _storage;
 };
 
 } // namespace leaf
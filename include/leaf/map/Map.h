@@ -25,19 +25,72 @@
 #ifndef _LEAF_MAP_H_
 #define _LEAF_MAP_H_
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include <tbb/concurrent_unordered_map.h>
 
 #include "Any.h"
+#include "Slot.h"
+#include "Snapshot.h"
 
 namespace leaf {
 
+// Concurrent map of type erased values. Live get takes no lock: it is safe against
+// concurrent handle stores, but not against set, bind or clear of the same key, which
+// rewrite the value in place. Readers running alongside writers use snapshot() or a handle.
 template <typename _KeyT>
 class LeafMap
 {
 public:
+    // Immutable view of published values, consistent across keys. Values bound to
+    // handles are copied at publish and not shared with the live map.
+    // Handle stores skip the writer lock and may land on either side of a publish.
+    class Snapshot
+    {
+    public:
+        // Count
+        size_t size() const
+        {
+            return _map->size();
+        }
+
+        // Get
+        template <typename _TypeT>
+        bool get(const _KeyT &key, _TypeT &val, const _TypeT &default_val) const
+        {
+            if (get(key, val))
+            {
+                return true;
+            }
+            val = default_val;
+            return false;
+        }
+
+        template <typename _TypeT>
+        bool get(const _KeyT &key, _TypeT &val) const
+        {
+            auto iter = _map->find(key);
+            if (iter == _map->end())
+            {
+                return false;
+            }
+            return Slot<_TypeT>::TryRead(iter->second, val);
+        }
+
+    private:
+        friend class LeafMap;
+
+        explicit Snapshot(std::shared_ptr<const std::unordered_map<_KeyT, Any>> map) : _map(map) {}
+
+        std::shared_ptr<const std::unordered_map<_KeyT, Any>> _map;
+    };
+
     // Clear
     void clear()
     {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
         _map.clear();
     }
 
@@ -47,48 +100,98 @@ public:
         return _map.size();
     }
 
-    // Set
+    // Set, false if key is bound to handle of another type
     template <typename _TypeT>
-    void set(const _KeyT &key, const _TypeT &val)
+    bool set(const _KeyT &key, const _TypeT &val)
     {
-        _map[key] = val;
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        return Slot<_TypeT>::Write(_map[key], val);
     }
 
-    // Get
+    // Get, missing key is not inserted, false and stored value untouched on type mismatch.
+    // Lock free, races with set of the same unbound key, see class comment.
     template <typename _TypeT>
     bool get(const _KeyT &key, _TypeT &val, const _TypeT &default_val)
     {
-        Any &v = _map[key];
-        if (v.empty())
+        auto iter = _map.find(key);
+        if (iter == _map.end() || iter->second.empty())
+        {
+            val = default_val;
+            return false;
+        }
+        if (!Slot<_TypeT>::Read(iter->second, val))
         {
             val = default_val;
             return false;
         }
-        val = Any::Cast<_TypeT>(v);
         return true;
     }
 
     template <typename _TypeT>
     bool get(const _KeyT &key, _TypeT &val)
     {
-        Any &v = _map[key];
-        if (v.empty())
+        auto iter = _map.find(key);
+        if (iter == _map.end() || iter->second.empty())
         {
             return false;
         }
-        val = Any::Cast<_TypeT>(v);
-        return true;
+        return Slot<_TypeT>::Read(iter->second, val);
     }
 
-    // Bind
+    // Handle, resolve key once at initialization, later set and get of key go through the same slot.
+    // Invalid slot if key holds value of another type.
+    template <typename _TypeT>
+    Slot<_TypeT> handle(const _KeyT &key)
+    {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        return Slot<_TypeT>::Bind(_map[key]);
+    }
+
+    // Publish deep copy of current values as new snapshot version, call from writer after batch of set
+    void publish()
+    {
+        std::shared_ptr<std::unordered_map<_KeyT, Any>> version = std::make_shared<std::unordered_map<_KeyT, Any>>();
+
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        for (auto &pair : _map)
+        {
+            if (!pair.second.empty())
+            {
+                version->emplace(pair.first, SlotCellBase::Resolve(pair.second));
+            }
+        }
+        _published.publish(version);
+    }
+
+    // Snapshot of last published version, cached per thread. Taking or copying one costs
+    // an atomic reference count increment, holding it keeps that version alive.
+    Snapshot snapshot()
+    {
+        return Snapshot(_published.acquire());
+    }
+
+    // Bind, null if key is bound to handle or holds value of another type
     template <typename _TypeT>
     _TypeT *unsafe_bind(const _KeyT &key)
     {
-        return &(Any::Cast<_TypeT>(_map[key]));
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        Any &any = _map[key];
+        if (any.empty())
+        {
+            return &any.emplace<_TypeT>();
+        }
+        else if (!any.is<_TypeT>())
+        {
+            return nullptr;
+        }
+        return &(Any::Cast<_TypeT>(any));
     }
 
 private:
+    // Serializes set, bind and publish, live get does not take it
+    std::mutex _writer_mutex;
     tbb::concurrent_unordered_map<_KeyT, Any> _map;
+    Publisher<std::unordered_map<_KeyT, Any>> _published;
 };
 
 } // namespace leaf
@@ -25,19 +25,78 @@
 #ifndef _LEAF_SECTION_MAP_H_
 #define _LEAF_SECTION_MAP_H_
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include <tbb/concurrent_unordered_map.h>
 
 #include "Any.h"
+#include "Slot.h"
+#include "Snapshot.h"
 
 namespace leaf {
 
+// Concurrent map of type erased values. Live get takes no lock: it is safe against
+// concurrent handle stores, but not against set, bind or clear of the same key, which
+// rewrite the value in place. Readers running alongside writers use snapshot() or a handle.
 template <typename _SecT, typename _KeyT>
 class SectionMap
 {
 public:
+    // Immutable view of published values, consistent across sections and keys.
+    // Values bound to handles are copied at publish and not shared with the live map.
+    // Handle stores skip the writer lock and may land on either side of a publish.
+    class Snapshot
+    {
+    public:
+        // Count
+        size_t size() const
+        {
+            return _section_map->size();
+        }
+
+        // Get
+        template <typename _TypeT>
+        bool get(const _SecT &section, const _KeyT &key, _TypeT &val, const _TypeT &default_val) const
+        {
+            if (get(section, key, val))
+            {
+                return true;
+            }
+            val = default_val;
+            return false;
+        }
+
+        template <typename _TypeT>
+        bool get(const _SecT &section, const _KeyT &key, _TypeT &val) const
+        {
+            auto sec_iter = _section_map->find(section);
+            if (sec_iter == _section_map->end())
+            {
+                return false;
+            }
+
+            auto key_iter = sec_iter->second.find(key);
+            if (key_iter == sec_iter->second.end())
+            {
+                return false;
+            }
+            return Slot<_TypeT>::TryRead(key_iter->second, val);
+        }
+
+    private:
+        friend class SectionMap;
+
+        explicit Snapshot(std::shared_ptr<const std::unordered_map<_SecT, std::unordered_map<_KeyT, Any>>> map) : _section_map(map) {}
+
+        std::shared_ptr<const std::unordered_map<_SecT, std::unordered_map<_KeyT, Any>>> _section_map;
+    };
+
     // Clear
     void clear()
     {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
         _section_map.clear();
     }
 
@@ -58,48 +117,120 @@ public:
         return s;
     }
 
-    // Set
+    // Set, false if key is bound to handle of another type
     template <typename _TypeT>
-    void set(const _SecT &section, const _KeyT &key, const _TypeT &val)
+    bool set(const _SecT &section, const _KeyT &key, const _TypeT &val)
     {
-        _section_map[section][key] = val;
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        return Slot<_TypeT>::Write(_section_map[section][key], val);
     }
 
-    // Get
+    // Get, missing section or key is not inserted, false and stored value untouched on type mismatch.
+    // Lock free, races with set of the same unbound key, see class comment.
     template <typename _TypeT>
     bool get(const _SecT &section, const _KeyT &key, _TypeT &val, const _TypeT &default_val)
     {
-        Any &v = _section_map[section][key];
-        if (v.empty())
+        Any *v = find(section, key);
+        if (v == nullptr || v->empty())
+        {
+            val = default_val;
+            return false;
+        }
+        if (!Slot<_TypeT>::Read(*v, val))
         {
             val = default_val;
             return false;
         }
-        val = Any::Cast<_TypeT>(v);
         return true;
     }
 
     template <typename _TypeT>
     bool get(const _SecT &section, const _KeyT &key, _TypeT &val)
     {
-        Any &v = _section_map[section][key];
-        if (v.empty())
+        Any *v = find(section, key);
+        if (v == nullptr || v->empty())
         {
             return false;
         }
-        val = Any::Cast<_TypeT>(v);
-        return true;
+        return Slot<_TypeT>::Read(*v, val);
     }
 
-    // Bind
+    // Handle, resolve section and key once at initialization, later set and get of key go through the same slot.
+    // Invalid slot if key holds value of another type.
+    template <typename _TypeT>
+    Slot<_TypeT> handle(const _SecT &section, const _KeyT &key)
+    {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        return Slot<_TypeT>::Bind(_section_map[section][key]);
+    }
+
+    // Publish deep copy of current values as new snapshot version, call from writer after batch of set
+    void publish()
+    {
+        std::shared_ptr<std::unordered_map<_SecT, std::unordered_map<_KeyT, Any>>> version =
+            std::make_shared<std::unordered_map<_SecT, std::unordered_map<_KeyT, Any>>>();
+
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        for (auto &map_vk : _section_map)
+        {
+            std::unordered_map<_KeyT, Any> &section = (*version)[map_vk.first];
+
+            for (auto &pair : map_vk.second)
+            {
+                if (!pair.second.empty())
+                {
+                    section.emplace(pair.first, SlotCellBase::Resolve(pair.second));
+                }
+            }
+        }
+        _published.publish(version);
+    }
+
+    // Snapshot of last published version, cached per thread. Taking or copying one costs
+    // an atomic reference count increment, holding it keeps that version alive.
+    Snapshot snapshot()
+    {
+        return Snapshot(_published.acquire());
+    }
+
+    // Bind, null if key is bound to handle or holds value of another type
     template <typename _TypeT>
     _TypeT *unsafe_bind(const _SecT &section, const _KeyT &key)
     {
-        return &(Any::Cast<_TypeT>(_section_map[section][key]));
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        Any &any = _section_map[section][key];
+        if (any.empty())
+        {
+            return &any.emplace<_TypeT>();
+        }
+        else if (!any.is<_TypeT>())
+        {
+            return nullptr;
+        }
+        return &(Any::Cast<_TypeT>(any));
     }
 
 private:
+    Any *find(const _SecT &section, const _KeyT &key)
+    {
+        auto sec_iter = _section_map.find(section);
+        if (sec_iter == _section_map.end())
+        {
+            return nullptr;
+        }
+
+        auto key_iter = sec_iter->second.find(key);
+        if (key_iter == sec_iter->second.end())
+        {
+            return nullptr;
+        }
+        return &key_iter->second;
+    }
+
+    // Serializes set, bind and publish, live get does not take it
+    std::mutex _writer_mutex;
     tbb::concurrent_unordered_map<_SecT, tbb::concurrent_unordered_map<_KeyT, Any>> _section_map;
+    Publisher<std::unordered_map<_SecT, std::unordered_map<_KeyT, Any>>> _published;
 };
 
 } // namespace leaf
@@ -0,0 +1,292 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_SLOT_H_
+#define _LEAF_SLOT_H_
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+#include <string.h>
+#include <stdint.h>
+
+#include <tbb/spin_mutex.h>
+
+#include "Any.h"
+
+namespace leaf {
+
+// Type erased cell stored in map, tagged with value type so typed access can be checked
+class SlotCellBase
+{
+public:
+    virtual ~SlotCellBase() = default;
+
+    // Current value copied into plain Any
+    virtual Any value() const = 0;
+
+    template <typename _TypeT>
+    bool is() const
+    {
+        return _tag == Tag<_TypeT>();
+    }
+
+    // Plain copy of map value, bound cell is replaced by its current value
+    static Any Resolve(const Any &any)
+    {
+        if (any.is<std::shared_ptr<SlotCellBase>>())
+        {
+            return Any::Cast<std::shared_ptr<SlotCellBase>>(any)->value();
+        }
+        return any;
+    }
+
+protected:
+    explicit SlotCellBase(const void *tag) : _tag(tag) {}
+
+    template <typename _TypeT>
+    static const void *Tag()
+    {
+        static const char tag = 0;
+        return &tag;
+    }
+
+private:
+    const void *_tag;
+};
+
+// Shared value cell, seqlock over atomic words for trivially copyable types
+template <typename _TypeT, bool _TrivialT = std::is_trivially_copyable<_TypeT>::value>
+class SlotCell : public SlotCellBase
+{
+public:
+    SlotCell(const _TypeT &val) : SlotCellBase(Tag<_TypeT>()), _sequence(0)
+    {
+        store(val);
+    }
+
+    Any value() const override
+    {
+        return Any(load());
+    }
+
+    // Wait-free unless a write is in progress, then retry
+    _TypeT load() const
+    {
+        uint64_t words[WordCount];
+        uint32_t before, after;
+
+        do
+        {
+            before = _sequence.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i < WordCount; i++)
+            {
+                words[i] = _words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        _TypeT val;
+        memcpy(&val, words, sizeof(_TypeT));
+        return val;
+    }
+
+    // Writers exclude each other by making sequence odd
+    void store(const _TypeT &val)
+    {
+        uint64_t words[WordCount] = {0};
+        memcpy(words, &val, sizeof(_TypeT));
+
+        uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+
+        while ((sequence & 1) || !_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire))
+        {
+            sequence = _sequence.load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WordCount; i++)
+        {
+            _words[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+private:
+    static const size_t WordCount = (sizeof(_TypeT) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> _sequence;
+    std::atomic<uint64_t> _words[WordCount];
+};
+
+// Shared value cell, spin lock for other types
+template <typename _TypeT>
+class SlotCell<_TypeT, false> : public SlotCellBase
+{
+public:
+    SlotCell(const _TypeT &val) : SlotCellBase(Tag<_TypeT>()), _value(val) {}
+
+    Any value() const override
+    {
+        return Any(load());
+    }
+
+    _TypeT load() const
+    {
+        tbb::spin_mutex::scoped_lock lock(_mutex);
+        return _value;
+    }
+
+    void store(const _TypeT &val)
+    {
+        tbb::spin_mutex::scoped_lock lock(_mutex);
+        _value = val;
+    }
+
+private:
+    mutable tbb::spin_mutex _mutex;
+    _TypeT _value;
+};
+
+// Typed handle of map value, resolved once and accessed without hashing.
+// Handle keeps its cell alive even after the map is cleared.
+template <typename _TypeT>
+class Slot
+{
+public:
+    typedef std::shared_ptr<SlotCell<_TypeT>> cell_ptr;
+    typedef std::shared_ptr<SlotCellBase> base_ptr;
+
+    Slot() = default;
+
+    explicit Slot(cell_ptr cell) : _cell(cell) {}
+
+    bool valid() const
+    {
+        return _cell != nullptr;
+    }
+
+    _TypeT load() const
+    {
+        return _cell->load();
+    }
+
+    void store(const _TypeT &val)
+    {
+        _cell->store(val);
+    }
+
+    // Whether map value is bound to handles, of any type
+    static bool Bound(const Any &any)
+    {
+        return any.is<base_ptr>();
+    }
+
+    // Turn map value into a cell shared with handle, existing value of same type is kept.
+    // Value or cell of another type is left untouched and invalid slot is returned.
+    // Caller serializes bind with other writers of the same map.
+    static Slot Bind(Any &any)
+    {
+        if (Bound(any))
+        {
+            return Slot(Cell(any));
+        }
+        if (!any.empty() && !any.is<_TypeT>())
+        {
+            return Slot();
+        }
+
+        cell_ptr cell = std::make_shared<SlotCell<_TypeT>>(any.empty() ? _TypeT() : Any::Cast<_TypeT>(any));
+        any = base_ptr(cell);
+        return Slot(cell);
+    }
+
+    // Read map value, either plain or bound to handles, false and nothing written if type mismatch
+    static bool Read(const Any &any, _TypeT &val)
+    {
+        return TryRead(any, val);
+    }
+
+    // Read map value without changing it, false if type mismatch
+    static bool TryRead(const Any &any, _TypeT &val)
+    {
+        if (Bound(any))
+        {
+            cell_ptr cell = Cell(any);
+            if (!cell)
+            {
+                return false;
+            }
+            val = cell->load();
+        }
+        else if (any.is<_TypeT>())
+        {
+            val = Any::Cast<_TypeT>(any);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Write map value, either plain or bound to handles, false if bound to another type
+    static bool Write(Any &any, const _TypeT &val)
+    {
+        if (Bound(any))
+        {
+            cell_ptr cell = Cell(any);
+            if (!cell)
+            {
+                return false;
+            }
+            cell->store(val);
+        }
+        else
+        {
+            any = val;
+        }
+        return true;
+    }
+
+private:
+    // Typed cell of bound value, null if bound to another type
+    static cell_ptr Cell(const Any &any)
+    {
+        const base_ptr &base = Any::Cast<base_ptr>(any);
+        return base->template is<_TypeT>() ? std::static_pointer_cast<SlotCell<_TypeT>>(base) : nullptr;
+    }
+
+    cell_ptr _cell;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_SLOT_H_ */
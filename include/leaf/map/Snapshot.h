@@ -0,0 +1,83 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_SNAPSHOT_H_
+#define _LEAF_SNAPSHOT_H_
+
+#include <atomic>
+#include <memory>
+
+#include <stdint.h>
+
+#include <tbb/enumerable_thread_specific.h>
+
+namespace leaf {
+
+// Immutable data published by writer as a whole new version. Each reader thread caches
+// latest version and only touches the shared pointer when a new version was published.
+template <typename _DataT>
+class Publisher
+{
+public:
+    typedef std::shared_ptr<const _DataT> data_ptr;
+
+    Publisher() : _data(std::make_shared<const _DataT>()), _version(1) {}
+
+    void publish(data_ptr data)
+    {
+        std::atomic_store(&_data, data);
+        _version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Latest data for calling thread, owned by the returned pointer
+    data_ptr acquire()
+    {
+        Cache &cache = _cache.local();
+        uint64_t version = _version.load(std::memory_order_acquire);
+
+        if (cache.version != version)
+        {
+            cache.data = std::atomic_load(&_data);
+            cache.version = version;
+        }
+        return cache.data;
+    }
+
+private:
+    struct Cache
+    {
+        Cache() : version(0) {}
+
+        uint64_t version;
+        data_ptr data;
+    };
+
+    data_ptr _data;
+    std::atomic<uint64_t> _version;
+    tbb::enumerable_thread_specific<Cache> _cache;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_SNAPSHOT_H_ */
@@ -0,0 +1,232 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_ARENA_H_
+#define _LEAF_ARENA_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fstream>
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <tbb/task_arena.h>
+#include <tbb/global_control.h>
+#include <tbb/task_scheduler_observer.h>
+#include <tbb/enumerable_thread_specific.h>
+
+namespace leaf {
+
+// Pin TBB workers entering arena to given CPUs, restore their own mask on exit. Threads
+// joining arena by execute are left alone. Each arena keeps its own saved masks, so a
+// worker moving through nested arenas gets every mask back. Pinning is Linux only,
+// elsewhere observer does nothing.
+class ArenaAffinity : public tbb::task_scheduler_observer
+{
+public:
+    ArenaAffinity(tbb::task_arena &arena, const std::vector<int32_t> &cpus)
+        : tbb::task_scheduler_observer(arena), _cpus(cpus)
+    {
+        observe(true);
+    }
+
+    ~ArenaAffinity()
+    {
+        observe(false);
+    }
+
+    void on_scheduler_entry(bool is_worker) override
+    {
+#ifdef __linux__
+        if (!is_worker)
+        {
+            return;
+        }
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+
+        for (auto cpu : _cpus)
+        {
+            CPU_SET(cpu, &mask);
+        }
+
+        SavedMask &saved = _saved.local();
+        saved.valid = sched_getaffinity(0, sizeof(cpu_set_t), &saved.mask) == 0;
+        sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+#endif
+    }
+
+    void on_scheduler_exit(bool is_worker) override
+    {
+#ifdef __linux__
+        SavedMask &saved = _saved.local();
+
+        if (is_worker && saved.valid)
+        {
+            sched_setaffinity(0, sizeof(cpu_set_t), &saved.mask);
+            saved.valid = false;
+        }
+#endif
+    }
+
+    // CPUs of NUMA node from sysfs, empty if node unknown or has memory only
+    static std::vector<int32_t> NodeCpus(int32_t node)
+    {
+        return ReadList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    }
+
+    // Online NUMA nodes from sysfs, numbers may have gaps, empty if unknown
+    static std::vector<int32_t> OnlineNodes()
+    {
+        return ReadList("/sys/devices/system/node/online");
+    }
+
+    // Parse sysfs list like "0-3,8-11\n", blank or malformed ranges are skipped
+    static std::vector<int32_t> ParseList(const std::string &list)
+    {
+        std::vector<int32_t> values;
+        size_t begin = 0;
+
+        while (begin < list.size())
+        {
+            size_t end = list.find(',', begin);
+            std::string range = list.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+            const char *cursor = range.c_str();
+            char *next = nullptr;
+
+            begin = end == std::string::npos ? list.size() : end + 1;
+
+            long first = strtol(cursor, &next, 10);
+            if (next == cursor || first < 0)
+            {
+                continue;
+            }
+
+            long last = first;
+            while (isspace((unsigned char)*next))
+            {
+                next++;
+            }
+            if (*next == '-')
+            {
+                cursor = next + 1;
+                last = strtol(cursor, &next, 10);
+                if (next == cursor || last < first)
+                {
+                    continue;
+                }
+            }
+
+            for (long value = first; value <= last; value++)
+            {
+                values.push_back((int32_t)value);
+            }
+        }
+        return values;
+    }
+
+private:
+    static std::vector<int32_t> ReadList(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string list;
+
+        std::getline(file, list);
+        return ParseList(list);
+    }
+
+#ifdef __linux__
+    struct SavedMask
+    {
+        SavedMask() : valid(false) {}
+
+        cpu_set_t mask;
+        bool valid;
+    };
+
+    tbb::enumerable_thread_specific<SavedMask> _saved;
+#endif
+
+    std::vector<int32_t> _cpus;
+};
+
+// Task arena of its own for a module, optionally pinned to CPUs. Work is enqueued and
+// run by arena workers, so callers never wait for a slot. Without any TBB worker
+// (max_allowed_parallelism of 1) enqueued work would never run, callers then execute
+// it themselves.
+class IsolatedArena
+{
+public:
+    IsolatedArena(int32_t concurrency, const std::vector<int32_t> &cpus)
+        : _arena(concurrency, 0),
+          _asynchronous(tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism) > 1)
+    {
+        _arena.initialize();
+
+        if (!cpus.empty())
+        {
+            _affinity.reset(new ArenaAffinity(_arena, cpus));
+        }
+    }
+
+    // Run function in arena and wait for it, caller joins arena when a slot is free
+    template <typename _FuncT>
+    void execute(const _FuncT &func)
+    {
+        _arena.execute(func);
+    }
+
+    // Run function in arena without waiting, or at once if arena has no worker
+    template <typename _FuncT>
+    void enqueue(_FuncT &&func)
+    {
+        if (_asynchronous)
+        {
+            _arena.enqueue(std::forward<_FuncT>(func));
+        }
+        else
+        {
+            _arena.execute(func);
+        }
+    }
+
+private:
+    tbb::task_arena _arena;
+    bool _asynchronous;
+    // Destroyed before arena
+    std::unique_ptr<ArenaAffinity> _affinity;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_ARENA_H_ */
@@ -0,0 +1,251 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_AUTOTUNER_H_
+#define _LEAF_AUTOTUNER_H_
+
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+namespace leaf {
+
+// Cumulative counters of one stage, taken by pipeline at every tuning step
+struct StageSample
+{
+    size_t concurrency;
+    size_t running;
+    size_t pending;
+    uint64_t processed;
+    // Recorded runtime, zero while statistic is not recording
+    uint64_t runtime_count;
+    uint64_t runtime_sum;
+};
+
+struct TuneDecision
+{
+    std::string name;
+    size_t from;
+    size_t to;
+    double throughput;  // Frames per second during last interval
+    double service;     // Mean module runtime in ms
+    double utilization; // Busy share of concurrency slots
+    size_t pending;
+    uint64_t time;      // Statistic::Now() of decision
+};
+
+// Concurrency controller. Grows the most utilized stage with a backlog by one slot per
+// step while busy slots of all tuned stages fit thread budget, shrinks idle stages.
+// Busy slots are throughput times service time (Little's law) when runtime is recorded,
+// otherwise running frames at sampling time.
+class ConcurrencyTuner
+{
+public:
+    static const size_t MaxHistory = 256;
+
+    ConcurrencyTuner(size_t budget = std::thread::hardware_concurrency())
+        : _budget(budget > 0 ? budget : 1), _grow_above(0.75), _shrink_below(0.4)
+    {
+    }
+
+    void track(const std::string &name, size_t min_concurrency, size_t max_concurrency)
+    {
+        _stages[name].min = min_concurrency;
+        _stages[name].max = max_concurrency;
+    }
+
+    void clear()
+    {
+        _stages.clear();
+    }
+
+    bool tracked(const std::string &name)
+    {
+        return _stages.count(name) != 0;
+    }
+
+    std::vector<std::string> names()
+    {
+        std::vector<std::string> result;
+
+        for (auto &pair : _stages)
+        {
+            result.push_back(pair.first);
+        }
+        return result;
+    }
+
+    // Threads tuned stages may keep busy together
+    void set_budget(size_t budget)
+    {
+        _budget = budget > 0 ? budget : 1;
+    }
+
+    // Feed samples of tracked stages taken at now ns, returns changes to apply
+    std::vector<TuneDecision> step(const std::map<std::string, StageSample> &samples, uint64_t now)
+    {
+        std::vector<TuneDecision> decisions;
+        std::vector<TuneDecision> loads;
+        double busy = 0;
+
+        for (auto &pair : samples)
+        {
+            auto iter = _stages.find(pair.first);
+
+            if (iter == _stages.end())
+            {
+                continue;
+            }
+
+            TunedStage &stage = iter->second;
+            const StageSample &sample = pair.second;
+            size_t clamped = std::min(std::max(sample.concurrency, stage.min), stage.max);
+
+            // Concurrency changed outside tuner, bring it back into range and measure from here
+            if (clamped != sample.concurrency)
+            {
+                decisions.push_back({pair.first, sample.concurrency, clamped, 0, 0, 0, sample.pending, now});
+                stage.last = sample;
+                stage.time = 0;
+                continue;
+            }
+
+            // Stage replaced under the same name restarts its counters, take a fresh baseline
+            bool restarted = sample.processed < stage.last.processed;
+
+            if (stage.time != 0 && now > stage.time && !restarted)
+            {
+                TuneDecision load = measure(pair.first, stage, sample, now);
+
+                busy += load.utilization * sample.concurrency;
+                loads.push_back(load);
+            }
+
+            stage.last = sample;
+            stage.time = now;
+        }
+
+        // Grow bottleneck, one slot per step so effect is seen before next change
+        TuneDecision *bottleneck = nullptr;
+
+        for (auto &load : loads)
+        {
+            if (load.pending > 0 && load.utilization >= _grow_above && load.from < _stages[load.name].max &&
+                (bottleneck == nullptr || load.utilization > bottleneck->utilization ||
+                 (load.utilization == bottleneck->utilization && load.pending > bottleneck->pending)))
+            {
+                bottleneck = &load;
+            }
+        }
+
+        if (bottleneck != nullptr && busy + 1 <= _budget)
+        {
+            bottleneck->to = bottleneck->from + 1;
+            decisions.push_back(*bottleneck);
+        }
+
+        // Shrink idle stages, give slots back to budget
+        for (auto &load : loads)
+        {
+            if (load.pending == 0 && load.utilization < _shrink_below && load.from > _stages[load.name].min)
+            {
+                load.to = load.from - 1;
+                decisions.push_back(load);
+            }
+        }
+
+        for (auto &decision : decisions)
+        {
+            _history.push_back(decision);
+
+            if (_history.size() > MaxHistory)
+            {
+                _history.pop_front();
+            }
+        }
+        return decisions;
+    }
+
+    std::vector<TuneDecision> history()
+    {
+        return std::vector<TuneDecision>(_history.begin(), _history.end());
+    }
+
+    void print_history()
+    {
+        printf("=========================== Concurrency Autotune =============================\n");
+        printf("Time(ms)   Name   From   To   Throughput   Service   Utilization   Pending\n");
+        printf("------------------------------------------------------------------------------\n");
+        for (auto &decision : _history)
+        {
+            printf("%" PRIu64 "  %s  %zu  %zu  %.1f  %.4f  %.2f  %zu\n", decision.time / 1000000,
+                   decision.name.c_str(), decision.from, decision.to, decision.throughput,
+                   decision.service, decision.utilization, decision.pending);
+        }
+        printf("=========================== Concurrency Autotune =============================\n");
+    }
+
+private:
+    struct TunedStage
+    {
+        TunedStage() : min(1), max(1), last(), time(0) {}
+
+        size_t min;
+        size_t max;
+        StageSample last;
+        uint64_t time;
+    };
+
+    TuneDecision measure(const std::string &name, TunedStage &stage, const StageSample &sample, uint64_t now)
+    {
+        double seconds = (now - stage.time) / 1e9;
+        // Recording restarted resets runtime counters
+        bool recorded = sample.runtime_count > stage.last.runtime_count;
+        uint64_t count = recorded ? sample.runtime_count - stage.last.runtime_count : 0;
+        double throughput = (sample.processed - stage.last.processed) / seconds;
+        double service = count > 0 ? (double)(sample.runtime_sum - stage.last.runtime_sum) / count / 1e6 : 0;
+        double slots = count > 0 ? throughput * service / 1e3 : (double)sample.running;
+        double utilization = sample.concurrency > 0 ? slots / sample.concurrency : 0;
+
+        return {name, sample.concurrency, sample.concurrency, throughput, service, utilization, sample.pending, now};
+    }
+
+    size_t _budget;
+    double _grow_above;
+    double _shrink_below;
+
+    std::map<std::string, TunedStage> _stages;
+    std::deque<TuneDecision> _history;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_AUTOTUNER_H_ */
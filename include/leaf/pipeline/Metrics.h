@@ -0,0 +1,352 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_METRICS_H_
+#define _LEAF_METRICS_H_
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <initializer_list>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Statistic.h"
+
+namespace leaf {
+
+// Monotonic counter, lock-free to update
+class MetricCounter
+{
+public:
+    MetricCounter() : _value(0) {}
+
+    void add(uint64_t n = 1)
+    {
+        _value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value()
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _value;
+};
+
+// Gauge of current value, lock-free to update
+class MetricGauge
+{
+public:
+    MetricGauge() : _value(0) {}
+
+    void set(double value)
+    {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    void add(double delta)
+    {
+        double value = _value.load(std::memory_order_relaxed);
+
+        while (!_value.compare_exchange_weak(value, value + delta, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    double value()
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> _value;
+};
+
+// Samples of one scrape grouped by metric family, formatted as Prometheus text
+class MetricWriter
+{
+public:
+    // Add sample, labels formatted by Metrics::Labels, suffix like "_sum" appended to name
+    void add(const std::string &name, const char *type, const std::string &help,
+             const std::string &labels, double value, const char *suffix = "")
+    {
+        Family &family = _families[name];
+        char number[32];
+
+        family.type = type;
+        family.help = help;
+
+        snprintf(number, sizeof(number), "%.10g", value);
+        family.samples.push_back(name + suffix + (labels.empty() ? "" : "{" + labels + "}") + " " + number);
+    }
+
+    // Summary of statistic in seconds, quantiles are P50, P99 and P999
+    void add(const std::string &name, const std::string &help, const std::string &labels, const ModuleStatistic &stat)
+    {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+
+        add(name, "summary", help, prefix + "quantile=\"0.5\"", stat.p50 / 1e3);
+        add(name, "summary", help, prefix + "quantile=\"0.99\"", stat.p99 / 1e3);
+        add(name, "summary", help, prefix + "quantile=\"0.999\"", stat.p999 / 1e3);
+        add(name, "summary", help, labels, stat.avg * stat.count / 1e3, "_sum");
+        add(name, "summary", help, labels, (double)stat.count, "_count");
+    }
+
+    std::string text()
+    {
+        std::string text;
+
+        for (auto &pair : _families)
+        {
+            text += "# HELP " + pair.first + " " + pair.second.help + "\n";
+            text += "# TYPE " + pair.first + " " + pair.second.type + "\n";
+
+            for (auto &sample : pair.second.samples)
+            {
+                text += sample + "\n";
+            }
+        }
+        return text;
+    }
+
+private:
+    struct Family
+    {
+        std::string type;
+        std::string help;
+        std::vector<std::string> samples;
+    };
+
+    std::map<std::string, Family> _families;
+};
+
+// Registry of metrics exposed in Prometheus text format. Registry lock is only taken
+// when registering and scraping, hot path updates atomics of counters and gauges,
+// collectors read atomics of their owner.
+class Metrics
+{
+public:
+    typedef std::function<void(MetricWriter &)> collector;
+
+    // Format label set, values are escaped
+    static std::string Labels(std::initializer_list<std::pair<std::string, std::string>> labels)
+    {
+        std::string text;
+
+        for (auto &label : labels)
+        {
+            text += (text.empty() ? "" : ",") + label.first + "=\"" + Escape(label.second) + "\"";
+        }
+        return text;
+    }
+
+    // Counter of name and labels, pointer stays valid for program lifetime
+    static MetricCounter *Counter(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        Registry &registry = Get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        Entry<MetricCounter> &entry = registry.counters[std::make_pair(name, labels)];
+
+        if (entry.metric == nullptr)
+        {
+            entry.metric.reset(new MetricCounter());
+            entry.help = help;
+        }
+        return entry.metric.get();
+    }
+
+    // Gauge of name and labels, pointer stays valid for program lifetime
+    static MetricGauge *Gauge(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        Registry &registry = Get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        Entry<MetricGauge> &entry = registry.gauges[std::make_pair(name, labels)];
+
+        if (entry.metric == nullptr)
+        {
+            entry.metric.reset(new MetricGauge());
+            entry.help = help;
+        }
+        return entry.metric.get();
+    }
+
+    // Collector called at every scrape until owner unregisters
+    static void Register(const void *owner, collector collect)
+    {
+        Registry &registry = Get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        registry.collectors.push_back(std::make_pair(owner, collect));
+    }
+
+    // Remove collectors of owner, call before owner is destroyed
+    static void Unregister(const void *owner)
+    {
+        Registry &registry = Get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        auto &collectors = registry.collectors;
+
+        for (auto iter = collectors.begin(); iter != collectors.end();)
+        {
+            iter = iter->first == owner ? collectors.erase(iter) : iter + 1;
+        }
+    }
+
+    // Scrape every metric and statistic in Prometheus text format
+    static std::string Expose()
+    {
+        Registry &registry = Get();
+        MetricWriter writer;
+
+        for (auto &stat : Statistic::Collect(StatisticKind::Runtime))
+        {
+            writer.add("leaf_module_runtime_seconds", "Time spent inside module update.",
+                       Labels({{"module", stat.name}}), stat);
+        }
+
+        for (auto &stat : Statistic::Collect(StatisticKind::Wait))
+        {
+            writer.add("leaf_queue_wait_seconds", "Time frames waited in front of module.",
+                       Labels({{"module", stat.name}}), stat);
+        }
+
+        for (auto &stat : Statistic::Collect(StatisticKind::Latency))
+        {
+            writer.add("leaf_latency_seconds", "Push to end latency of frames.",
+                       Labels({{"frames", stat.name}}), stat);
+        }
+
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        for (auto &pair : registry.counters)
+        {
+            writer.add(pair.first.first, "counter", pair.second.help, pair.first.second, (double)pair.second.metric->value());
+        }
+
+        for (auto &pair : registry.gauges)
+        {
+            writer.add(pair.first.first, "gauge", pair.second.help, pair.first.second, pair.second.metric->value());
+        }
+
+        for (auto &pair : registry.collectors)
+        {
+            pair.second(writer);
+        }
+
+        return writer.text();
+    }
+
+private:
+    template <class _MetricT>
+    struct Entry
+    {
+        std::unique_ptr<_MetricT> metric;
+        std::string help;
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::map<std::pair<std::string, std::string>, Entry<MetricCounter>> counters;
+        std::map<std::pair<std::string, std::string>, Entry<MetricGauge>> gauges;
+        std::vector<std::pair<const void *, collector>> collectors;
+    };
+
+    static std::string Escape(const std::string &value)
+    {
+        std::string text;
+
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                text += '\\';
+                text += c;
+            }
+            else if (c == '\n')
+            {
+                text += "\\n";
+            }
+            else
+            {
+                text += c;
+            }
+        }
+        return text;
+    }
+
+    // Registry is never destroyed, owners may unregister during static destruction
+    static Registry &Get()
+    {
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+};
+
+// Export occupancy and drops of a buffer at every metrics scrape while alive. Declare
+// it after the buffer it watches so it is destroyed first.
+template <class _BufferT>
+class BufferMetrics
+{
+public:
+    BufferMetrics(_BufferT &buffer, std::string buffer_name)
+    {
+        std::string labels = Metrics::Labels({{"buffer", buffer_name}});
+        std::string rejected = Metrics::Labels({{"buffer", buffer_name}, {"reason", "rejected"}});
+        std::string evicted = Metrics::Labels({{"buffer", buffer_name}, {"reason", "evicted"}});
+        _BufferT *watched = &buffer;
+
+        Metrics::Register(this, [watched, labels, rejected, evicted](MetricWriter &writer) {
+            auto stat = watched->statistic();
+
+            writer.add("leaf_buffer_size", "gauge", "Frames held in buffer.", labels, (double)stat.size);
+            writer.add("leaf_buffer_capacity", "gauge", "Max frames held in buffer.", labels, (double)stat.capacity);
+            writer.add("leaf_buffer_dropped_total", "counter", "Frames dropped by drop policy.", rejected, (double)stat.rejected);
+            writer.add("leaf_buffer_dropped_total", "counter", "Frames dropped by drop policy.", evicted, (double)stat.evicted);
+        });
+    }
+
+    ~BufferMetrics()
+    {
+        Metrics::Unregister(this);
+    }
+
+    BufferMetrics(const BufferMetrics &) = delete;
+    BufferMetrics &operator=(const BufferMetrics &) = delete;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_METRICS_H_ */
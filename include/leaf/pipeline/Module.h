@@ -25,6 +25,8 @@
 #ifndef _LEAF_MODULE_H_
 #define _LEAF_MODULE_H_
 
+#include <vector>
+
 namespace leaf {
 
 template<class _FrameT>
@@ -38,6 +40,15 @@ public:
     }
 
     virtual void update(typename _FrameT::ptr &frame) = 0;
+
+    // Update frames batched by pipeline, default update one by one
+    virtual void update_batch(std::vector<typename _FrameT::ptr> &frames)
+    {
+        for (auto &frame : frames)
+        {
+            update(frame);
+        }
+    }
 };
 
 } // namespace leaf
@@ -25,31 +25,61 @@
 #ifndef _LEAF_PIPELINE_H_
 #define _LEAF_PIPELINE_H_
 
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
 
 #include <tbb/flow_graph.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/concurrent_priority_queue.h>
 #include <tbb/concurrent_unordered_map.h>
 
+#include "Arena.h"
+#include "Trace.h"
+#include "../buffer/RingQueue.h"
+#include "../buffer/EventCount.h"
 #include "Module.h"
+#include "Metrics.h"
+#include "Autotuner.h"
 #include "Statistic.h"
 
 namespace leaf {
 
+// How push_frame admits frames when pipeline is at max capacity
+enum class Admission
+{
+    Advisory, // Always accept, overload() is only a hint
+    Reject,   // Reject newest frame, caller keeps it
+    Block     // Wait until a frame leaves pipeline, producer runs frames itself without workers
+};
+
 template <class _FrameT>
 class Pipeline
 {
 public:
-    Pipeline(int32_t max) : _max_capacity(max), _current_load(0)
+    Pipeline(int32_t max, Admission admission = Admission::Advisory)
+        : _max_capacity(max), _current_load(0), _admission(admission), _token_waiters(0), _sequence(0),
+          _ticket_pool(max > 0 ? 2 * max : 1), _tune_stop(true)
     {
         // Pipline input node
-        _graph_input_node.reset(new tbb::flow::broadcast_node<typename _FrameT::ptr>(_process_graph));
+        _graph_input_node.reset(new tbb::flow::broadcast_node<frame_message>(_process_graph));
         // Pipline end node
-        _datafrm_eol_node.reset(new tbb::flow::function_node<typename _FrameT::ptr, tbb::flow::continue_msg>(_process_graph, tbb::flow::serial, DataFrameEndOfLife(_current_load)));
+        _datafrm_eol_node.reset(new tbb::flow::function_node<frame_message, tbb::flow::continue_msg>(_process_graph, tbb::flow::serial, DataFrameEndOfLife(this)));
     }
 
     virtual ~Pipeline()
     {
+        // Stop exporting before state goes away
+        Metrics::Unregister(this);
+        // Stop autotuner before nodes go away
+        stop_autotune();
         // Wait for process graph finish existing pipeline works
         wait_finish();
         // Terminate all process nodes
@@ -57,6 +87,13 @@ public:
         // Terminate all io nodes
         _graph_input_node.reset();
         _datafrm_eol_node.reset();
+
+        frame_ticket *ticket = nullptr;
+
+        while (_ticket_pool.try_pop(ticket))
+        {
+            delete ticket;
+        }
     }
 
     // Wait for pipeline finish
@@ -65,22 +102,83 @@ public:
         _process_graph.wait_for_all();
     }
 
-    // Push frame into pipeline
-    bool push_frame(typename _FrameT::ptr frame)
+    // Push frame into pipeline, admitted according to admission policy. Frames of higher
+    // priority overtake frames queued in front of prioritized modules.
+    bool push_frame(typename _FrameT::ptr frame, int32_t priority = 0)
     {
-        // Start Pipeline
-        bool success = (frame != nullptr) && _graph_input_node->try_put(frame);
-        if (success)
+        if (frame == nullptr)
+        {
+            return false;
+        }
+
+        switch (_admission)
         {
+        case Admission::Advisory:
             _current_load++;
+            break;
+        case Admission::Reject:
+            if (!try_acquire_token())
+            {
+                return false;
+            }
+            break;
+        case Admission::Block:
+            acquire_token(std::chrono::steady_clock::time_point::max());
+            break;
         }
-        return success;
+
+        return put_frame(frame, priority);
+    }
+
+    // Push frame into pipeline, wait at most timeout for capacity regardless of admission policy
+    bool try_push_frame(typename _FrameT::ptr frame, std::chrono::microseconds timeout, int32_t priority = 0)
+    {
+        if (frame == nullptr || !acquire_token(std::chrono::steady_clock::now() + timeout))
+        {
+            return false;
+        }
+
+        return put_frame(frame, priority);
     }
 
     // Check if pipeline overloaded
     bool overload()
     {
-        return _current_load > _max_capacity;
+        return _current_load >= _max_capacity;
+    }
+
+    // Export load and stage state at every metrics scrape, labeled by pipeline name
+    void export_metrics(std::string pipeline_name)
+    {
+        std::string labels = Metrics::Labels({{"pipeline", pipeline_name}});
+
+        Metrics::Unregister(this);
+        Metrics::Register(this, [this, pipeline_name, labels](MetricWriter &writer) {
+            writer.add("leaf_pipeline_load", "gauge", "Frames in flight holding a token.", labels, _current_load.load());
+            writer.add("leaf_pipeline_capacity", "gauge", "Max frames in flight.", labels, _max_capacity);
+            writer.add("leaf_pipeline_token_waiters", "gauge", "Producers waiting for a token.", labels, _token_waiters.load());
+
+            std::lock_guard<std::mutex> lock(_stage_mutex);
+
+            for (auto &pair : _stage_map)
+            {
+                StageControl &stage = *pair.second;
+                std::string stage_labels = Metrics::Labels({{"pipeline", pipeline_name}, {"module", pair.first}});
+
+                writer.add("leaf_stage_concurrency", "gauge", "Concurrency limit of module.", stage_labels, stage.limit.load());
+                writer.add("leaf_stage_running", "gauge", "Frames running in module.", stage_labels, stage.running.load());
+                writer.add("leaf_stage_pending", "gauge", "Frames queued in front of module.", stage_labels, stage.pending_count.load());
+                writer.add("leaf_stage_processed_total", "counter", "Frames processed by module.", stage_labels,
+                           (double)stage.processed.load(std::memory_order_relaxed));
+            }
+        });
+    }
+
+    // Concurrency changes made by autotuner, latest last
+    std::vector<TuneDecision> autotune_decisions()
+    {
+        std::lock_guard<std::mutex> lock(_tune_mutex);
+        return _tuner.history();
     }
 
 protected:
@@ -106,23 +204,101 @@ protected:
         return true;
     }
 
-    // Connect nodes in process garph
+    // Deliver frames to node in push order, node itself still runs with its own concurrency
+    bool order_module(std::string module_name)
+    {
+        if (module_name != _datafrm_eol_name && _module_map[module_name] == nullptr)
+        {
+            return false;
+        }
+
+        // Frames enter batch concurrently, order a later module instead
+        if (_batch_map.count(module_name) != 0 || _prioritized_map[module_name])
+        {
+            return false;
+        }
+
+        _ordered_map[module_name] = true;
+
+        return true;
+    }
+
+    // Collect up to max_batch frames or wait up to max_wait before module, module gets them
+    // in one update_batch call and frames continue one by one. Batches run one at a time,
+    // so module must be added with concurrency 1.
+    bool batch_module(std::string module_name, size_t max_batch, std::chrono::microseconds max_wait)
+    {
+        if (_module_map[module_name] == nullptr || max_batch == 0 || _concurrency_map[module_name] != 1 ||
+            _ordered_map[module_name] || _prioritized_map[module_name] || _arena_map.count(module_name) != 0)
+        {
+            return false;
+        }
+
+        _batch_map[module_name] = std::make_shared<BatchQueue>(max_batch, max_wait);
+
+        return true;
+    }
+
+    // Queue frames waiting for module by priority instead of arrival, module only takes
+    // next frame when a concurrency slot is free. Excludes ordered and batched module.
+    bool prioritize_module(std::string module_name)
+    {
+        if (_module_map[module_name] == nullptr || _ordered_map[module_name] || _batch_map.count(module_name) != 0)
+        {
+            return false;
+        }
+
+        _prioritized_map[module_name] = true;
+
+        return true;
+    }
+
+    // Run module on workers of a task arena of its own with concurrency threads, pinned to
+    // cpus if given. Graph threads only hand frames over and never wait for the arena.
+    // Keep module concurrency within arena concurrency. Excludes batched module.
+    bool isolate_module(std::string module_name, int32_t concurrency, std::vector<int32_t> cpus = std::vector<int32_t>())
+    {
+        if (_module_map[module_name] == nullptr || concurrency <= 0 || _batch_map.count(module_name) != 0)
+        {
+            return false;
+        }
+
+        _arena_map[module_name] = std::make_shared<IsolatedArena>(concurrency, cpus);
+
+        return true;
+    }
+
+    // Run module_to right after module_from inside node of module_from, on the same thread
+    // without a task spawn between them. module_to must be the only successor of module_from
+    // and module_from its only predecessor, module_to must allow at least the concurrency of
+    // module_from and not be ordered, prioritized, batched or isolated. Each module still
+    // records its own statistic. Fused modules keep the concurrency they were fused with.
+    bool fuse_module(std::string module_from, std::string module_to)
+    {
+        if (_fused_map.count(module_to) != 0 || fusion_tail(module_from) != nullptr || !fusable(module_from, module_to))
+        {
+            return false;
+        }
+
+        _fused_map[module_to] = module_from;
+
+        return true;
+    }
+
+    // Connect nodes in process garph, a node may have several successors and predecessors
     bool connect_module(std::string module_from, std::string module_to)
     {
         if (module_from == _graph_input_name && _module_map[module_to] != nullptr)
         {
-            _connection_map[_graph_input_name] = module_to;
-            return true;
+            return add_connection(_graph_input_name, module_to);
         }
         else if (_module_map[module_from] != nullptr && module_to == _datafrm_eol_name)
         {
-            _connection_map[module_from] = _datafrm_eol_name;
-            return true;
+            return add_connection(module_from, _datafrm_eol_name);
         }
         else if (_module_map[module_from] != nullptr && _module_map[module_to] != nullptr)
         {
-            _connection_map[module_from] = module_to;
-            return true;
+            return add_connection(module_from, module_to);
         }
         else
         {
@@ -139,6 +315,15 @@ protected:
             return false;
         }
 
+        // Fusion needs connections to stay a single edge
+        for (auto &pair : _fused_map)
+        {
+            if (!fusable(pair.second, pair.first) || _predecessor_map[pair.first].size() != 1)
+            {
+                return false;
+            }
+        }
+
         // Initialize all module, create node
         for (auto &name : _connection_list)
         {
@@ -147,150 +332,1394 @@ protected:
                 continue;
             }
 
-            size_t concurrency = _concurrency_map[name];
-            std::shared_ptr<node_module> module = _module_map[name];
-
-            module->post_initialize();
+            _module_map[name]->post_initialize();
 
-            _node_map[name].reset(new process_node(_process_graph, concurrency, ModuleWrapper(module, name)));
+            create_stage(name);
         }
 
-        // Connect all node
-        // _connection_list.size() must greater than 2
-        for (size_t i = 1; i < _connection_list.size(); i++)
+        // Fused module is processed by stage in front of it, chain sends from node of its head
+        for (auto &pair : _fused_map)
         {
-            std::string node_from = _connection_list[i - 1];
-            std::string node_to = _connection_list[i];
+            _stage_map[pair.second]->fused = _stage_map[pair.first];
+            _stage_map[pair.first]->port = _stage_map[fusion_head(pair.first)]->port;
+        }
 
-            if (i == 1)
+        // Re-serialize frames in front of ordered end node, ordered stages do it themselves
+        for (auto &name : _connection_list)
+        {
+            if (name != _datafrm_eol_name || !_ordered_map[name])
             {
-                tbb::flow::make_edge(*_graph_input_node, *_node_map[node_to]);
+                continue;
             }
-            else if (i == _connection_list.size() - 1)
+
+            std::shared_ptr<sequencer_node> sequencer(new sequencer_node(_process_graph, FrameSequence()));
+
+            tbb::flow::make_edge(*sequencer, node_body(name));
+
+            _sequencer_map[name] = sequencer;
+        }
+
+        // New sequencers and ordered stages expect sequence starting from zero
+        _sequence = 0;
+
+        // Connect all node, fan-out is done by node output broadcasting to every successor,
+        // fan-in is done by join nodes matching the same frame from every predecessor
+        for (auto &name : _connection_list)
+        {
+            // Fused module has no node of its own
+            if (name == _graph_input_name || _fused_map.count(name) != 0)
             {
-                tbb::flow::make_edge(*_node_map[node_from], *_datafrm_eol_node);
+                continue;
             }
-            else
+
+            std::vector<std::string> &predecessors = _predecessor_map[name];
+
+            tbb::flow::sender<frame_message> *joined = &node_output(predecessors[0]);
+
+            for (size_t i = 1; i < predecessors.size(); i++)
             {
-                tbb::flow::make_edge(*_node_map[node_from], *_node_map[node_to]);
+                std::shared_ptr<join_node> join(new join_node(_process_graph, FrameKey(), FrameKey()));
+                std::shared_ptr<split_node> split(new split_node(_process_graph, tbb::flow::unlimited, FrameSplit()));
+
+                tbb::flow::make_edge(*joined, tbb::flow::input_port<0>(*join));
+                tbb::flow::make_edge(node_output(predecessors[i]), tbb::flow::input_port<1>(*join));
+                tbb::flow::make_edge(*join, *split);
+
+                _join_nodes.push_back(join);
+                _join_nodes.push_back(split);
+
+                joined = split.get();
             }
+
+            tbb::flow::make_edge(*joined, node_input(name));
         }
 
         return true;
     }
 
-    // Reset process pipeline
-    void reset_pipeline()
+    // Let autotuner change module concurrency within min and max, module must be thread
+    // safe when max is above one. Current concurrency, unlimited too, is clamped into range.
+    bool autotune_module(std::string module_name, size_t min_concurrency, size_t max_concurrency)
     {
-        _node_map.clear();
-        _module_map.clear();
-        _connection_map.clear();
-        _concurrency_map.clear();
-        _connection_list.clear();
+        if (_module_map[module_name] == nullptr || _batch_map.count(module_name) != 0 || fused(module_name) ||
+            min_concurrency == 0 || min_concurrency > max_concurrency)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(_tune_mutex);
+        _tuner.track(module_name, min_concurrency, max_concurrency);
+
+        size_t concurrency = StageControl::Limit(_concurrency_map[module_name]);
+        size_t clamped = std::min(std::max(concurrency, min_concurrency), max_concurrency);
+
+        if (clamped != concurrency)
+        {
+            set_concurrency(module_name, clamped);
+        }
+
+        return true;
     }
 
-    // Check if garph node connections completed
-    bool check_connection()
+    // Tune autotuned modules every interval on a background thread, budget is threads all
+    // tuned modules may keep busy. Stop autotune before inserting or removing modules.
+    bool start_autotune(std::chrono::milliseconds interval, size_t budget = std::thread::hardware_concurrency())
     {
-        std::string prev;
-        std::string next = _graph_input_name;
+        std::lock_guard<std::mutex> lock(_tune_mutex);
 
-        _connection_list.clear();
+        if (!_tune_stop)
+        {
+            return false;
+        }
+
+        _tuner.set_budget(budget);
+        _tune_stop = false;
+        _tune_thread = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(_tune_mutex);
+
+            while (!_tune_cond.wait_for(lock, interval, [this]() { return _tune_stop; }))
+            {
+                autotune();
+            }
+        });
+
+        return true;
+    }
+
+    void stop_autotune()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_tune_mutex);
+            _tune_stop = true;
+        }
+        _tune_cond.notify_all();
+
+        if (_tune_thread.joinable())
+        {
+            _tune_thread.join();
+        }
+    }
 
-        while (!next.empty())
+    // Replace module of a stage while frames flow, new module is initialized first.
+    // Frames already inside old module finish there, old module is kept until reset.
+    template <class _MdulT>
+    bool swap_module(std::string module_name)
+    {
+        if (_module_map[module_name] == nullptr)
         {
-            prev = next;
-            _connection_list.push_back(prev);
+            return false;
+        }
+
+        std::shared_ptr<node_module> module = std::make_shared<_MdulT>();
+        auto stage = _stage_map.find(module_name);
 
-            next = _connection_map[next];
+        if (stage != _stage_map.end())
+        {
+            module->post_initialize();
+            stage->second->module.store(module.get(), std::memory_order_release);
+            _retired_modules.push_back(_module_map[module_name]);
         }
 
-        return (prev == _datafrm_eol_name) && (_connection_list.size() > 2);
+        _module_map[module_name] = module;
+
+        return true;
     }
 
-    // Get garph node connections list in ordrer
-    std::vector<std::string> &connection_list()
+    // Change concurrency of a stage while frames flow, batched stage keeps one batch at a time
+    bool set_concurrency(std::string module_name, size_t concurrency)
     {
-        return _connection_list;
+        if (_module_map[module_name] == nullptr || _batch_map.count(module_name) != 0 || fused(module_name))
+        {
+            return false;
+        }
+
+        _concurrency_map[module_name] = concurrency;
+
+        auto stage = _stage_map.find(module_name);
+
+        if (stage != _stage_map.end())
+        {
+            size_t limit = StageControl::Limit(concurrency);
+            size_t previous = stage->second->limit.exchange(limit);
+
+            // Wake extra drainers for frames already pending, empty message only drains
+            size_t wake = limit > previous ? std::min(limit - previous, stage->second->pending_count.load()) : 0;
+
+            for (size_t i = 0; i < wake; i++)
+            {
+                _node_map[module_name]->try_put(frame_message{nullptr, nullptr, 0, 0, 0, 0, false});
+            }
+        }
+
+        return true;
     }
 
-private:
-    // Process node in pipeline
-    typedef tbb::flow::function_node<typename _FrameT::ptr, typename _FrameT::ptr> process_node;
-    // Node Module in pipeline
-    typedef Module<_FrameT> node_module;
+    // Insert new module between two connected modules while frames flow, module_from is
+    // paused only while its output edge is swapped. Edge must be the only successor of
+    // module_from and the only predecessor of module_to.
+    template <class _MdulT>
+    bool insert_module(std::string module_name, size_t concurrency, std::string module_from, std::string module_to)
+    {
+        if (_module_map[module_name] != nullptr || !linear_edge(module_from, module_to))
+        {
+            return false;
+        }
 
-    // Data frame endpoint in pipeline. End data life cycle, release memory resources
-    class DataFrameEndOfLife
+        add_module<_MdulT>(module_name, concurrency);
+        _module_map[module_name]->post_initialize();
+        create_stage(module_name);
+
+        tbb::flow::make_edge(node_output(module_name), node_input(module_to));
+
+        StageControl &stage_from = *_stage_map[module_from];
+
+        pause_stage(stage_from);
+        tbb::flow::remove_edge(node_output(module_from), node_input(module_to));
+        tbb::flow::make_edge(node_output(module_from), node_input(module_name));
+        resume_stage(stage_from);
+
+        _connection_map[module_from] = std::vector<std::string>(1, module_name);
+        _connection_map[module_name] = std::vector<std::string>(1, module_to);
+        _predecessor_map[module_name] = std::vector<std::string>(1, module_from);
+        _predecessor_map[module_to] = std::vector<std::string>(1, module_name);
+        _connection_list.insert(std::find(_connection_list.begin(), _connection_list.end(), module_to), module_name);
+
+        return true;
+    }
+
+    // Remove module from a chain of modules while frames flow, frames already pending in
+    // it still reach its successor. Ordered module can not be removed, it
+    // would wait for frames that bypass it.
+    bool remove_module(std::string module_name)
     {
-    private:
-        tbb::atomic<int32_t> &_current_load;
+        if (_predecessor_map[module_name].size() != 1 || _connection_map[module_name].size() != 1 || _ordered_map[module_name])
+        {
+            return false;
+        }
 
-    public:
-        DataFrameEndOfLife(tbb::atomic<int32_t> &cpl) : _current_load(cpl) {}
+        std::string module_from = _predecessor_map[module_name][0];
+        std::string module_to = _connection_map[module_name][0];
 
-        tbb::flow::continue_msg operator()(typename _FrameT::ptr frame)
+        if (!linear_edge(module_from, module_name) || _predecessor_map[module_to].size() != 1)
         {
-            _FrameT::Dispose(frame);
-            --_current_load;
-            return tbb::flow::continue_msg();
+            return false;
         }
-    };
 
-    // Wrapper class for node modules
-    class ModuleWrapper
-    {
-    private:
-        std::string _module_name;
-        std::shared_ptr<node_module> _module_body;
+        StageControl &stage_from = *_stage_map[module_from];
 
-    public:
-        ModuleWrapper(std::shared_ptr<node_module> body, std::string name)
-            : _module_body(body), _module_name(name)
+        pause_stage(stage_from);
+        tbb::flow::remove_edge(node_output(module_from), node_input(module_name));
+        tbb::flow::make_edge(node_output(module_from), node_input(module_to));
+        resume_stage(stage_from);
+
+        // Removed node keeps forwarding its pending frames
+        if (_batch_node_map.count(module_name) != 0)
+        {
+            _retired_nodes.push_back(_batch_node_map[module_name]);
+            _batch_node_map.unsafe_erase(module_name);
+            _batch_map.unsafe_erase(module_name);
+        }
+        else
         {
+            _retired_nodes.push_back(_node_map[module_name]);
+            _node_map.unsafe_erase(module_name);
         }
 
-        typename _FrameT::ptr operator()(typename _FrameT::ptr frame)
+        _retired_modules.push_back(_module_map[module_name]);
+        _module_map.unsafe_erase(module_name);
         {
-            #ifdef MODULE_TIMMING
-            tbb::tick_count t0 = tbb::tick_count::now();
-            #endif /* MODULE_TIMMING */
+            std::lock_guard<std::mutex> lock(_stage_mutex);
+            _stage_map.unsafe_erase(module_name);
+        }
+        _concurrency_map.unsafe_erase(module_name);
+        _prioritized_map.unsafe_erase(module_name);
+        _arena_map.unsafe_erase(module_name);
+
+        _connection_map[module_from] = std::vector<std::string>(1, module_to);
+        _predecessor_map[module_to] = std::vector<std::string>(1, module_from);
+        _connection_map.unsafe_erase(module_name);
+        _predecessor_map.unsafe_erase(module_name);
+        _connection_list.erase(std::find(_connection_list.begin(), _connection_list.end(), module_name));
 
-            _module_body->update(frame);
+        return true;
+    }
 
-            #ifdef MODULE_TIMMING
-            float interval = 1000 * (tbb::tick_count::now() - t0).seconds();
-            Statistic::RecordRuntime(_module_name, interval);
-            #endif /* MODULE_TIMMING */
+    // Reset process pipeline
+    void reset_pipeline()
+    {
+        stop_autotune();
+        _tuner.clear();
 
-            return frame;
+        _join_nodes.clear();
+        _sequencer_map.clear();
+        _batch_node_map.clear();
+        _node_map.clear();
+        _retired_nodes.clear();
+        {
+            std::lock_guard<std::mutex> lock(_stage_mutex);
+            _stage_map.clear();
         }
-    };
+        _retired_modules.clear();
+        _module_map.clear();
+        _connection_map.clear();
+        _predecessor_map.clear();
+        _concurrency_map.clear();
+        _ordered_map.clear();
+        _prioritized_map.clear();
+        _batch_map.clear();
+        _arena_map.clear();
+        _fused_map.clear();
+        _connection_list.clear();
+    }
 
-    // Process graph of pipeline
-    tbb::flow::graph _process_graph;
+    // Check if garph node connections completed, every node reached from input must reach
+    // end node without cycle, _connection_list is filled in topological order
+    bool check_connection()
+    {
+        _connection_list.clear();
+        _predecessor_map.clear();
 
-    // Max capacity for pipeline to process Data frames
-    int32_t _max_capacity;
-    // Current load of pipeline when process Data frames
-    tbb::atomic<int32_t> _current_load;
+        // Collect nodes reached from input node
+        std::vector<std::string> reached(1, _graph_input_name);
 
-    // Map of node modules
-    tbb::concurrent_unordered_map<std::string, std::shared_ptr<node_module>> _module_map;
-    // Map of process nodes
-    tbb::concurrent_unordered_map<std::string, std::shared_ptr<process_node>> _node_map;
-    // Map of process nodes concurrency
-    tbb::concurrent_unordered_map<std::string, size_t> _concurrency_map;
+        for (size_t i = 0; i < reached.size(); i++)
+        {
+            for (auto &next : _connection_map[reached[i]])
+            {
+                if (_predecessor_map[next].empty())
+                {
+                    reached.push_back(next);
+                }
+                _predecessor_map[next].push_back(reached[i]);
+            }
+        }
 
-    // Map of process nodes connection
-    tbb::concurrent_unordered_map<std::string, std::string> _connection_map;
-    // List of process connection
-    std::vector<std::string> _connection_list;
+        // Sort reached nodes in topological order
+        tbb::concurrent_unordered_map<std::string, size_t> in_degree;
+
+        for (auto &name : reached)
+        {
+            in_degree[name] = _predecessor_map[name].size();
+        }
+
+        _connection_list.push_back(_graph_input_name);
+
+        for (size_t i = 0; i < _connection_list.size(); i++)
+        {
+            for (auto &next : _connection_map[_connection_list[i]])
+            {
+                if (--in_degree[next] == 0)
+                {
+                    _connection_list.push_back(next);
+                }
+            }
+        }
+
+        // Cycle exists if some nodes never get sorted
+        if (_connection_list.size() != reached.size())
+        {
+            return false;
+        }
+
+        // Every node except end node must have successor
+        for (auto &name : _connection_list)
+        {
+            if (name != _datafrm_eol_name && _connection_map[name].empty())
+            {
+                return false;
+            }
+        }
+
+        return (_connection_list.back() == _datafrm_eol_name) && (_connection_list.size() > 2);
+    }
+
+    // Get garph node connections list in topological ordrer
+    std::vector<std::string> &connection_list()
+    {
+        return _connection_list;
+    }
+
+private:
+    // Frame owned by pipeline from push until end of life, tickets are pooled. Branch after
+    // a fan-out gets a ticket of its own holding a copy of the frame pointer, so modules of
+    // parallel branches never touch the same pointer. Branch tickets are chained to root
+    // ticket and released with it.
+    struct frame_ticket
+    {
+        typename _FrameT::ptr frame;
+        std::atomic<frame_ticket *> branches;
+        frame_ticket *next;
+    };
+
+    // Message passed in process graph, frame tagged with its push sequence number. Copying
+    // message copies ticket addresses only, frame reference count is only touched when
+    // a branch forks.
+    struct frame_message
+    {
+        // Root ticket, identifies frame across branches
+        frame_ticket *ticket;
+        // Ticket holding frame pointer of this branch, root ticket on the trunk
+        frame_ticket *slot;
+        size_t sequence;
+        int32_t priority;
+        // Push time in ns while statistic is recording, otherwise 0
+        uint64_t push_time;
+        // Time frame was sent to current stage while statistic is recording or frame is
+        // traced, otherwise 0
+        uint64_t stamp;
+        bool traced;
+    };
+
+    // Frame a is processed after frame b
+    struct FramePriority
+    {
+        bool operator()(const frame_message &a, const frame_message &b) const
+        {
+            return a.priority < b.priority || (a.priority == b.priority && a.sequence > b.sequence);
+        }
+    };
+
+    // Frame a was pushed after frame b
+    struct FrameLater
+    {
+        bool operator()(const frame_message &a, const frame_message &b) const
+        {
+            return a.sequence > b.sequence;
+        }
+    };
+
+    // Process node in pipeline, concurrency is limited by its stage control
+    typedef tbb::flow::multifunction_node<frame_message, std::tuple<frame_message>> process_node;
+    // Node Module in pipeline
+    typedef Module<_FrameT> node_module;
+    // Join node in pipeline, match same frame from two predecessors
+    typedef tbb::flow::join_node<std::tuple<frame_message, frame_message>, tbb::flow::key_matching<uintptr_t>> join_node;
+    // Split node in pipeline, take the frame out of join node output
+    typedef tbb::flow::function_node<std::tuple<frame_message, frame_message>, frame_message> split_node;
+    // Batch node in pipeline, frames in and out one by one, processed in batches
+    typedef tbb::flow::multifunction_node<frame_message, std::tuple<frame_message>> batch_node;
+    // Sequencer node in pipeline, release frames in push order
+    typedef tbb::flow::sequencer_node<frame_message> sequencer_node;
+
+    // Frame identity used as join key
+    struct FrameKey
+    {
+        uintptr_t operator()(const frame_message &message) const
+        {
+            return reinterpret_cast<uintptr_t>(message.ticket);
+        }
+    };
+
+    // Both join node outputs are the same frame, pass on the first
+    struct FrameSplit
+    {
+        frame_message operator()(const std::tuple<frame_message, frame_message> &messages) const
+        {
+            return std::get<0>(messages);
+        }
+    };
+
+    // Add connection once
+    bool add_connection(const std::string &module_from, const std::string &module_to)
+    {
+        std::vector<std::string> &successors = _connection_map[module_from];
+
+        if (std::find(successors.begin(), successors.end(), module_to) == successors.end())
+        {
+            successors.push_back(module_to);
+        }
+        return true;
+    }
+
+    // Edge of constructed graph that can be rerouted by pausing stage module_from
+    bool linear_edge(const std::string &module_from, const std::string &module_to)
+    {
+        return _node_map.count(module_from) != 0 && _connection_map[module_from].size() == 1 &&
+               _connection_map[module_from][0] == module_to && _predecessor_map[module_to].size() == 1 &&
+               !fused(module_from) && !fused(module_to);
+    }
+
+    // Module can run inside stage of module_from, concurrency of module_from never exceeds
+    // concurrency module_to was added with
+    bool fusable(const std::string &module_from, const std::string &module_to)
+    {
+        if (_module_map[module_from] == nullptr || _module_map[module_to] == nullptr ||
+            _batch_map.count(module_from) != 0 || _batch_map.count(module_to) != 0 ||
+            _ordered_map[module_to] || _prioritized_map[module_to] || _arena_map.count(module_to) != 0)
+        {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_tune_mutex);
+
+            if (_tuner.tracked(module_from) || _tuner.tracked(module_to))
+            {
+                return false;
+            }
+        }
+
+        return _connection_map[module_from].size() == 1 && _connection_map[module_from][0] == module_to &&
+               StageControl::Limit(_concurrency_map[module_from]) <= StageControl::Limit(_concurrency_map[module_to]);
+    }
+
+    // Module fused after name, null if none
+    const std::string *fusion_tail(const std::string &name)
+    {
+        for (auto &pair : _fused_map)
+        {
+            if (pair.second == name)
+            {
+                return &pair.first;
+            }
+        }
+        return nullptr;
+    }
+
+    // First module of fused chain owning the node
+    std::string fusion_head(std::string name)
+    {
+        for (auto iter = _fused_map.find(name); iter != _fused_map.end(); iter = _fused_map.find(name))
+        {
+            name = iter->second;
+        }
+        return name;
+    }
+
+    bool fused(const std::string &name)
+    {
+        return _fused_map.count(name) != 0 || fusion_tail(name) != nullptr;
+    }
+
+    // Sample tuned stages and apply decisions, called with tune mutex held
+    void autotune()
+    {
+        std::map<std::string, StageSample> samples;
+
+        for (auto &name : _tuner.names())
+        {
+            auto iter = _stage_map.find(name);
+
+            if (iter == _stage_map.end())
+            {
+                continue;
+            }
+
+            StageControl &stage = *iter->second;
+            LatencyHistogram::Merged runtime;
+
+            if (Statistic::IsRecording())
+            {
+                runtime = stage.recorder->merge();
+            }
+
+            samples[name] = {stage.limit.load(), stage.running.load(), stage.pending_count.load(),
+                             stage.processed.load(std::memory_order_relaxed), runtime.count, runtime.sum};
+        }
+
+        for (auto &decision : _tuner.step(samples, Statistic::Now()))
+        {
+            set_concurrency(decision.name, decision.to);
+        }
+    }
+
+    // Create stage control and node of module
+    void create_stage(const std::string &name)
+    {
+        std::shared_ptr<StageControl> stage = std::make_shared<StageControl>(
+            _module_map[name], name, _concurrency_map[name], this, arena(name), _prioritized_map[name], _ordered_map[name]);
+
+        // Successor of a fan-out forks its own frame pointer
+        for (auto &predecessor : _predecessor_map[name])
+        {
+            stage->fork = stage->fork || _connection_map[predecessor].size() > 1;
+        }
+
+        if (_fused_map.count(name) != 0)
+        {
+            // Port is set once stage in front of it exists
+        }
+        else if (_batch_map.count(name) != 0)
+        {
+            _batch_node_map[name].reset(new batch_node(_process_graph, tbb::flow::unlimited, BatchWrapper(stage, _batch_map[name])));
+            _batch_map[name]->node = _batch_node_map[name].get();
+        }
+        else
+        {
+            _node_map[name].reset(new process_node(_process_graph, tbb::flow::unlimited, StageWrapper(stage)));
+            stage->port = &tbb::flow::output_port<0>(*_node_map[name]);
+        }
+
+        std::lock_guard<std::mutex> lock(_stage_mutex);
+        _stage_map[name] = stage;
+    }
+
+    // Isolated arena of module, null if module runs in graph arena
+    std::shared_ptr<IsolatedArena> arena(const std::string &name)
+    {
+        auto iter = _arena_map.find(name);
+        return iter != _arena_map.end() ? iter->second : nullptr;
+    }
+
+    // Sequence number of frame message
+    struct FrameSequence
+    {
+        size_t operator()(const frame_message &message) const
+        {
+            return message.sequence;
+        }
+    };
+
+    // Get output of node in process graph
+    tbb::flow::sender<frame_message> &node_output(const std::string &name)
+    {
+        if (name == _graph_input_name)
+        {
+            return *_graph_input_node;
+        }
+        else if (_fused_map.count(name) != 0)
+        {
+            return node_output(fusion_head(name));
+        }
+        else if (_batch_node_map.count(name) != 0)
+        {
+            return tbb::flow::output_port<0>(*_batch_node_map[name]);
+        }
+        return tbb::flow::output_port<0>(*_node_map[name]);
+    }
+
+    // Get input of node in process graph, sequencer in front if node is ordered
+    tbb::flow::receiver<frame_message> &node_input(const std::string &name)
+    {
+        if (_sequencer_map.count(name) != 0)
+        {
+            return *_sequencer_map[name];
+        }
+        return node_body(name);
+    }
+
+    // Get node running module or end node
+    tbb::flow::receiver<frame_message> &node_body(const std::string &name)
+    {
+        if (name == _datafrm_eol_name)
+        {
+            return *_datafrm_eol_node;
+        }
+        else if (_batch_node_map.count(name) != 0)
+        {
+            return *_batch_node_map[name];
+        }
+        return *_node_map[name];
+    }
+
+    // Data frame endpoint in pipeline. End data life cycle, release memory resources,
+    // record push to end latency of all frames and per priority while statistic is recording.
+    class DataFrameEndOfLife
+    {
+    private:
+        Pipeline *_pipeline;
+        RuntimeRecorder *_wait;
+        RuntimeRecorder *_latency;
+        // End node is serial, recorders resolved once per priority
+        std::map<int32_t, RuntimeRecorder *> _priority_latency;
+
+    public:
+        DataFrameEndOfLife(Pipeline *pipeline)
+            : _pipeline(pipeline), _wait(Statistic::ResolveWait(pipeline->_datafrm_eol_name)),
+              _latency(Statistic::ResolveLatency("All"))
+        {
+        }
+
+        tbb::flow::continue_msg operator()(frame_message message)
+        {
+            uint64_t begin = message.stamp != 0 ? Statistic::Now() : 0;
+
+            _pipeline->release_ticket(message.ticket);
+
+            if (begin != 0)
+            {
+                uint64_t end = Statistic::Now();
+
+                if (Statistic::IsRecording())
+                {
+                    _wait->record(begin > message.stamp ? begin - message.stamp : 0);
+                }
+
+                if (message.push_time != 0 && Statistic::IsRecording())
+                {
+                    RuntimeRecorder *&recorder = _priority_latency[message.priority];
+
+                    if (recorder == nullptr)
+                    {
+                        recorder = Statistic::ResolveLatency("Priority " + std::to_string(message.priority));
+                    }
+
+                    _latency->record(end - message.push_time);
+                    recorder->record(end - message.push_time);
+                }
+
+                if (message.traced)
+                {
+                    Trace::Record(_pipeline->_datafrm_eol_name, message.sequence, message.stamp, begin, end);
+                }
+            }
+
+            _pipeline->release_token();
+            return tbb::flow::continue_msg();
+        }
+    };
+
+    // Put admitted frame into graph, give back token on failure
+    bool put_frame(typename _FrameT::ptr &frame, int32_t priority)
+    {
+        // Sequence numbers must stay contiguous, input node always accepts since
+        // process nodes, sequencers and priority queues buffer frames
+        size_t sequence = _sequence++;
+        bool recording = Statistic::IsRecording();
+        bool traced = Trace::Sampled(sequence);
+        uint64_t now = recording || traced ? Statistic::Now() : 0;
+
+        frame_ticket *ticket = acquire_ticket();
+        ticket->frame = std::move(frame);
+
+        frame_message message = {ticket, ticket, sequence, priority, recording ? now : 0, now, traced};
+
+        if (_graph_input_node->try_put(message))
+        {
+            return true;
+        }
+        release_ticket(ticket);
+        release_token();
+        return false;
+    }
+
+    frame_ticket *acquire_ticket()
+    {
+        frame_ticket *ticket = nullptr;
+
+        if (!_ticket_pool.try_pop(ticket))
+        {
+            ticket = new frame_ticket();
+        }
+
+        ticket->branches.store(nullptr, std::memory_order_relaxed);
+        ticket->next = nullptr;
+        return ticket;
+    }
+
+    // Dispose frame of ticket and every branch forked from it
+    void release_ticket(frame_ticket *ticket)
+    {
+        frame_ticket *branch = ticket->branches.load(std::memory_order_acquire);
+
+        while (branch != nullptr)
+        {
+            frame_ticket *next = branch->next;
+
+            recycle_ticket(branch);
+            branch = next;
+        }
+        recycle_ticket(ticket);
+    }
+
+    void recycle_ticket(frame_ticket *ticket)
+    {
+        _FrameT::Dispose(ticket->frame);
+
+        if (!_ticket_pool.try_push(ticket))
+        {
+            delete ticket;
+        }
+    }
+
+    // Give message a frame pointer of its own, sibling branches only read pointer they
+    // forked from
+    void fork_ticket(frame_message &message)
+    {
+        frame_ticket *branch = acquire_ticket();
+
+        branch->frame = message.slot->frame;
+        branch->next = message.ticket->branches.load(std::memory_order_relaxed);
+
+        while (!message.ticket->branches.compare_exchange_weak(branch->next, branch, std::memory_order_release,
+                                                               std::memory_order_relaxed))
+        {
+        }
+
+        message.slot = branch;
+    }
+
+    // Take one token of max capacity without waiting
+    bool try_acquire_token()
+    {
+        int32_t load = _current_load.load();
+
+        while (load < _max_capacity)
+        {
+            if (_current_load.compare_exchange_weak(load, load + 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Take one token of max capacity, wait until deadline
+    bool acquire_token(std::chrono::steady_clock::time_point deadline)
+    {
+        if (try_acquire_token())
+        {
+            return true;
+        }
+
+        // No worker would run frames while producer sleeps, run them here until tokens come back
+        while (Unassisted())
+        {
+            _process_graph.wait_for_all();
+
+            if (try_acquire_token())
+            {
+                return true;
+            }
+            else if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(_token_mutex);
+        _token_waiters++;
+
+        bool success = try_acquire_token();
+
+        while (!success)
+        {
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                _token_cond.wait(lock);
+            }
+            else if (_token_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                success = try_acquire_token();
+                break;
+            }
+            success = try_acquire_token();
+        }
+
+        _token_waiters--;
+        return success;
+    }
+
+    // Graph gets no worker threads, frames only run inside wait_for_all
+    static bool Unassisted()
+    {
+        return tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism) <= 1 ||
+               tbb::this_task_arena::max_concurrency() <= 1;
+    }
+
+    // Give back token, wake producer only if one is waiting
+    void release_token()
+    {
+        --_current_load;
+
+        if (_token_waiters > 0)
+        {
+            std::lock_guard<std::mutex> lock(_token_mutex);
+            _token_cond.notify_one();
+        }
+    }
+
+    // Runtime state of a module stage, shared by its node body and pipeline controls.
+    // Stage node accepts every frame into pending queue, up to limit callers drain it.
+    // Stage node bodies run in any order, so an ordered stage restores push order itself.
+    struct StageControl : std::enable_shared_from_this<StageControl>
+    {
+        StageControl(std::shared_ptr<node_module> body, const std::string &name, size_t concurrency,
+                     Pipeline *owner, std::shared_ptr<IsolatedArena> isolated, bool prioritized, bool ordered)
+            : module(body.get()), recorder(Statistic::Resolve(name)), wait_recorder(Statistic::ResolveWait(name)),
+              trace_name(Trace::Resolve(name)),
+              pipeline(owner), graph(&owner->_process_graph), arena(isolated), limit(Limit(concurrency)),
+              running(0), paused(false), pending_count(0), processed(0), priority(prioritized), order(ordered), next(0),
+              fork(false), port(nullptr)
+        {
+        }
+
+        // Node concurrency 0 is tbb::flow::unlimited
+        static size_t Limit(size_t concurrency)
+        {
+            return concurrency == tbb::flow::unlimited ? SIZE_MAX : concurrency;
+        }
+
+        // Count before publishing, so a drainer popping the frame at once never takes
+        // the count below zero
+        void push(const frame_message &message)
+        {
+            pending_count++;
+
+            if (priority)
+            {
+                prioritized.push(message);
+            }
+            else if (order)
+            {
+                sequenced.push(message);
+            }
+            else
+            {
+                fifo.push(message);
+            }
+        }
+
+        bool try_pop(frame_message &message)
+        {
+            if (priority)
+            {
+                return prioritized.try_pop(message);
+            }
+            else if (!order)
+            {
+                return fifo.try_pop(message);
+            }
+            else if (!sequenced.try_pop(message))
+            {
+                return false;
+            }
+
+            // Ordered stage only takes the frame pushed next
+            if (message.sequence == next)
+            {
+                next++;
+                return true;
+            }
+
+            sequenced.push(message);
+            return false;
+        }
+
+        // Frame can be taken, ordered stage waits for its next frame
+        bool ready()
+        {
+            frame_message message;
+
+            if (paused)
+            {
+                return false;
+            }
+            else if (!order)
+            {
+                return pending_count > 0;
+            }
+            else if (!sequenced.try_pop(message))
+            {
+                return false;
+            }
+
+            bool next_ready = message.sequence == next;
+
+            sequenced.push(message);
+            return next_ready;
+        }
+
+        // Take a concurrency slot while frames ready, last drainer leaving re-checks so
+        // a frame pushed meanwhile is never stranded. Slot of isolated stage runs on arena
+        // workers, graph is kept busy until it is given back.
+        void drain()
+        {
+            while (ready() && try_acquire())
+            {
+                if (arena == nullptr)
+                {
+                    run_slot();
+                    continue;
+                }
+
+                std::shared_ptr<StageControl> self = this->shared_from_this();
+
+                graph->reserve_wait();
+                arena->enqueue([self]() {
+                    self->run_slot();
+                    self->drain();
+                    self->graph->release_wait();
+                });
+            }
+        }
+
+        // Process pending frames with a taken slot, then give slot back
+        void run_slot()
+        {
+            frame_message message;
+
+            while (!paused && try_pop(message))
+            {
+                pending_count--;
+                process(message);
+            }
+
+            running--;
+        }
+
+        // Process frame at once if nothing is pending and a slot is free, paused stage
+        // is checked after taking slot since pausing waits for slots to be released
+        bool try_direct(frame_message &message)
+        {
+            if (order || arena != nullptr || pending_count != 0 || !try_acquire())
+            {
+                return false;
+            }
+
+            if (!paused)
+            {
+                process(message);
+                running--;
+                return true;
+            }
+
+            running--;
+            return false;
+        }
+
+        void process(frame_message &message)
+        {
+            bool timed = message.stamp != 0 || Statistic::IsRecording();
+            uint64_t begin = timed ? Statistic::Now() : 0;
+
+            update(message.slot->frame);
+
+            if (timed)
+            {
+                uint64_t end = Statistic::Now();
+
+                if (Statistic::IsRecording())
+                {
+                    recorder->record(end - begin);
+                }
+                stamp(message, begin, end);
+            }
+
+            processed.fetch_add(1, std::memory_order_relaxed);
+
+            if (fused != nullptr)
+            {
+                fused->process(message);
+            }
+            else
+            {
+                port->try_put(message);
+            }
+        }
+
+        bool try_acquire()
+        {
+            size_t count = running.load();
+
+            while (count < limit.load())
+            {
+                if (running.compare_exchange_weak(count, count + 1))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Record wait of frame stamped when sent to stage, which ran it from begin to end,
+        // and stamp it for next stage
+        void stamp(frame_message &message, uint64_t begin, uint64_t end)
+        {
+            if (message.stamp == 0)
+            {
+                return;
+            }
+
+            if (Statistic::IsRecording())
+            {
+                wait_recorder->record(begin > message.stamp ? begin - message.stamp : 0);
+            }
+
+            if (message.traced)
+            {
+                Trace::Record(trace_name, message.sequence, message.stamp, begin, end);
+            }
+
+            message.stamp = end;
+        }
+
+        void update(typename _FrameT::ptr &frame)
+        {
+            module.load(std::memory_order_acquire)->update(frame);
+        }
+
+        void update_batch(std::vector<typename _FrameT::ptr> &frames)
+        {
+            module.load(std::memory_order_acquire)->update_batch(frames);
+        }
+
+        // Module called by stage, swapped modules are kept alive by pipeline
+        std::atomic<node_module *> module;
+        RuntimeRecorder *recorder;
+        RuntimeRecorder *wait_recorder;
+        const char *trace_name;
+        Pipeline *pipeline;
+        tbb::flow::graph *graph;
+        std::shared_ptr<IsolatedArena> arena;
+
+        // Concurrency limit and callers draining
+        std::atomic<size_t> limit;
+        std::atomic<size_t> running;
+        // Paused stage keeps frames pending while its output edges are rewired
+        std::atomic<bool> paused;
+
+        // Frames pushed and not yet popped, may briefly exceed queue size
+        std::atomic<size_t> pending_count;
+        std::atomic<uint64_t> processed;
+        tbb::concurrent_queue<frame_message> fifo;
+        tbb::concurrent_priority_queue<frame_message, FramePriority> prioritized;
+        tbb::concurrent_priority_queue<frame_message, FrameLater> sequenced;
+        bool priority;
+
+        // Ordered stage sequence number of next frame
+        bool order;
+        std::atomic<size_t> next;
+
+        // Frames arrive from a fan-out, each branch needs a frame pointer of its own
+        bool fork;
+
+        // Stage processing frames right after this one on the same thread
+        std::shared_ptr<StageControl> fused;
+
+        // Output port of stage node, of chain head node if stage is fused
+        typename std::tuple_element<0, typename process_node::output_ports_type>::type *port;
+    };
+
+    // Wrapper class for node modules
+    class StageWrapper
+    {
+    private:
+        std::shared_ptr<StageControl> _stage;
+
+    public:
+        StageWrapper(std::shared_ptr<StageControl> stage) : _stage(stage) {}
+
+        void operator()(frame_message message, typename process_node::output_ports_type &)
+        {
+            if (message.ticket == nullptr)
+            {
+                // Concurrency raised, help draining
+            }
+            else
+            {
+                if (_stage->fork)
+                {
+                    _stage->pipeline->fork_ticket(message);
+                }
+
+                if (!_stage->try_direct(message))
+                {
+                    _stage->push(message);
+                }
+            }
+            _stage->drain();
+        }
+    };
+
+    // Quiesce output edges of stage, stage stops taking frames and its running frames
+    // finish. Graph is kept busy so wait_finish does not miss frames left pending.
+    void pause_stage(StageControl &stage)
+    {
+        _process_graph.reserve_wait();
+        stage.paused = true;
+
+        while (stage.running != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // Resume stage and process frames pended meanwhile
+    void resume_stage(StageControl &stage)
+    {
+        stage.paused = false;
+        stage.drain();
+        _process_graph.release_wait();
+    }
+
+    // Frames waiting for batched module
+    struct BatchQueue
+    {
+        BatchQueue(size_t batch, std::chrono::microseconds wait)
+            : pending_count(0), max_batch(batch), max_wait(wait), node(nullptr)
+        {
+        }
+
+        tbb::concurrent_queue<frame_message> pending;
+        std::atomic<size_t> pending_count;
+        // Drainer sleeps here for a partial batch to fill
+        EventCount arrived;
+
+        size_t max_batch;
+        std::chrono::microseconds max_wait;
+
+        // Node of batched module, drainer hands over to a new task through it
+        batch_node *node;
+    };
+
+    // Wrapper class for batched node modules. First caller finding queue idle drains it
+    // batch by batch, other callers only enqueue their frame and return. After MaxDrain
+    // batches the drainer hands the queue over to a new task instead of holding the worker.
+    class BatchWrapper
+    {
+    private:
+        std::shared_ptr<StageControl> _stage;
+        std::shared_ptr<BatchQueue> _queue;
+
+    public:
+        BatchWrapper(std::shared_ptr<StageControl> stage, std::shared_ptr<BatchQueue> queue)
+            : _stage(stage), _queue(queue)
+        {
+        }
+
+        static const size_t MaxDrain = 8;
+
+        void operator()(frame_message message, typename batch_node::output_ports_type &ports)
+        {
+            if (message.ticket == nullptr)
+            {
+                // Handed over by previous drainer, queue is still owned
+            }
+            else
+            {
+                if (_stage->fork)
+                {
+                    _stage->pipeline->fork_ticket(message);
+                }
+
+                // Count before publishing, so the drainer never subtracts a frame not yet counted
+                bool drainer = _queue->pending_count++ == 0;
+
+                _queue->pending.push(message);
+                _queue->arrived.notify_all();
+
+                if (!drainer)
+                {
+                    return;
+                }
+            }
+
+            std::vector<frame_message> messages;
+            std::vector<typename _FrameT::ptr> frames;
+            size_t remain = 0;
+            size_t drained = 0;
+
+            do
+            {
+                if (drained++ == MaxDrain)
+                {
+                    _queue->node->try_put(frame_message{nullptr, nullptr, 0, 0, 0, 0, false});
+                    return;
+                }
+
+                // Counted frames may still be on their way into the queue
+                if (!collect(messages))
+                {
+                    remain = _queue->pending_count;
+                    continue;
+                }
+
+                frames.clear();
+                for (auto &m : messages)
+                {
+                    // Branch owns its frame pointer here, move it in and out
+                    frames.push_back(std::move(m.slot->frame));
+                }
+
+                bool timed = Statistic::IsRecording() || Trace::IsTracing();
+                uint64_t begin = timed ? Statistic::Now() : 0;
+
+                _stage->update_batch(frames);
+
+                uint64_t end = timed ? Statistic::Now() : 0;
+
+                if (timed && Statistic::IsRecording())
+                {
+                    _stage->recorder->record(end - begin);
+                }
+
+                for (size_t i = 0; i < messages.size(); i++)
+                {
+                    if (timed)
+                    {
+                        _stage->stamp(messages[i], begin, end);
+                    }
+
+                    messages[i].slot->frame = std::move(frames[i]);
+                    std::get<0>(ports).try_put(messages[i]);
+                }
+
+                remain = (_queue->pending_count -= messages.size());
+            } while (remain != 0);
+        }
+
+    private:
+        // Take up to max_batch frames, sleep until max_wait passed if batch not full.
+        // False if no frame was taken.
+        // No wait when arena has no other thread that could deliver frames.
+        bool collect(std::vector<frame_message> &messages)
+        {
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + _queue->max_wait;
+            bool wait = tbb::this_task_arena::max_concurrency() > 1;
+            frame_message message;
+
+            messages.clear();
+
+            while (messages.size() < _queue->max_batch)
+            {
+                if (_queue->pending.try_pop(message))
+                {
+                    messages.push_back(message);
+                }
+                else if (!wait || !_queue->arrived.wait_until([this]() { return !_queue->pending.empty(); }, deadline))
+                {
+                    break;
+                }
+            }
+
+            return !messages.empty();
+        }
+    };
+
+    // Process graph of pipeline
+    tbb::flow::graph _process_graph;
+
+    // Max capacity for pipeline to process Data frames
+    int32_t _max_capacity;
+    // Current load of pipeline when process Data frames, frames in flight hold one token each
+    std::atomic<int32_t> _current_load;
+    // Admission policy when max capacity reached
+    Admission _admission;
+
+    // Producers waiting for token
+    std::atomic<int32_t> _token_waiters;
+    std::mutex _token_mutex;
+    std::condition_variable _token_cond;
+
+    // Map of node modules
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<node_module>> _module_map;
+    // Map of process nodes
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<process_node>> _node_map;
+    // Map of module stages runtime state
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<StageControl>> _stage_map;
+    // Guards stage map insert and erase against metrics scrape, frames never take it
+    std::mutex _stage_mutex;
+    // Map of batch nodes
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<batch_node>> _batch_node_map;
+    // Map of batched modules pending frames
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<BatchQueue>> _batch_map;
+    // Map of isolated modules task arenas
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<IsolatedArena>> _arena_map;
+    // Map of process nodes concurrency
+    tbb::concurrent_unordered_map<std::string, size_t> _concurrency_map;
+
+    // Nodes receiving frames in push order
+    tbb::concurrent_unordered_map<std::string, bool> _ordered_map;
+    // Sequencer nodes in front of ordered nodes
+    tbb::concurrent_unordered_map<std::string, std::shared_ptr<sequencer_node>> _sequencer_map;
+
+    // Nodes taking pending frames by priority
+    tbb::concurrent_unordered_map<std::string, bool> _prioritized_map;
+    // Fused modules to module in front of them
+    tbb::concurrent_unordered_map<std::string, std::string> _fused_map;
+    // Sequence number of next pushed frame
+    std::atomic<size_t> _sequence;
+    // Free frame tickets, more tickets in flight are allocated and freed
+    MPMCRing<frame_ticket *> _ticket_pool;
+
+    // Join and split nodes merging parallel branches
+    std::vector<std::shared_ptr<tbb::flow::graph_node>> _join_nodes;
+
+    // Modules swapped out and nodes removed while frames flowed, may still be in use
+    // until graph drains, released on reset
+    std::vector<std::shared_ptr<node_module>> _retired_modules;
+    std::vector<std::shared_ptr<tbb::flow::graph_node>> _retired_nodes;
+
+    // Map of process nodes connection, node to successors
+    tbb::concurrent_unordered_map<std::string, std::vector<std::string>> _connection_map;
+    // Map of process nodes connection, node to predecessors
+    tbb::concurrent_unordered_map<std::string, std::vector<std::string>> _predecessor_map;
+    // List of process connection
+    std::vector<std::string> _connection_list;
+
+    // Concurrency autotuner and its thread, tuner is guarded by tune mutex
+    ConcurrencyTuner _tuner;
+    std::thread _tune_thread;
+    std::mutex _tune_mutex;
+    std::condition_variable _tune_cond;
+    bool _tune_stop;
 
     // Input node of process graph
-    std::shared_ptr<tbb::flow::broadcast_node<typename _FrameT::ptr>> _graph_input_node;
+    std::shared_ptr<tbb::flow::broadcast_node<frame_message>> _graph_input_node;
     // End node of process graph
-    std::shared_ptr<tbb::flow::function_node<typename _FrameT::ptr, tbb::flow::continue_msg>> _datafrm_eol_node;
+    std::shared_ptr<tbb::flow::function_node<frame_message, tbb::flow::continue_msg>> _datafrm_eol_node;
 
     // IO nodes name
     const char *_graph_input_name = "[Graph_Input]";
@@ -0,0 +1,178 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_REPLAY_RECORDER_H_
+#define _LEAF_REPLAY_RECORDER_H_
+
+#include <mutex>
+#include <atomic>
+#include <string>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Module.h"
+#include "Statistic.h"
+#include "../frame/MappedFrame.h"
+
+namespace leaf {
+
+// Module writing frames into a replay file read by MappedReplayBuffer. Connect it
+// to [Dataframe_EOL] and order it, so frames are written in push order. A failed write
+// closes the file, records written before it stay readable.
+template <class _FrameT>
+class ReplayRecorder : public Module<_FrameT>
+{
+public:
+    ReplayRecorder() : _file(nullptr), _failed(false), _skipped(0) {}
+
+    ~ReplayRecorder() override
+    {
+        close();
+    }
+
+    void post_initialize() override
+    {
+        open(record_path());
+    }
+
+    void update(typename _FrameT::ptr &frame) override
+    {
+        std::string payload;
+
+        // File itself is checked under lock by write
+        if (!_failed.load(std::memory_order_relaxed) && encode(frame, payload))
+        {
+            // Payload size is stored in 32 bits
+            if (payload.size() > UINT32_MAX)
+            {
+                _skipped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            write(payload, timestamp(frame));
+        }
+    }
+
+    // Open or write of replay file failed, recorder stopped writing
+    bool failed()
+    {
+        return _failed.load(std::memory_order_relaxed);
+    }
+
+    // Frames skipped for payload too large to record
+    uint64_t skipped()
+    {
+        return _skipped.load(std::memory_order_relaxed);
+    }
+
+protected:
+    // Replay file written by recorder, opened when pipeline is constructed
+    virtual std::string record_path() = 0;
+
+    // Serialize frame into payload, return false to skip frame
+    virtual bool encode(typename _FrameT::ptr &frame, std::string &payload) = 0;
+
+    // Capture time written with frame in ns, default time frame reached recorder
+    virtual uint64_t timestamp(typename _FrameT::ptr & /* frame */)
+    {
+        return Statistic::Now();
+    }
+
+    bool open(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        close_file();
+        _file = fopen(path.c_str(), "wb");
+        _failed = false;
+
+        if (_file == nullptr)
+        {
+            fail("open");
+            return false;
+        }
+        else if (fwrite(ReplayFormat::Magic(), ReplayFormat::MagicSize(), 1, _file) != 1)
+        {
+            fail("write");
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        close_file();
+    }
+
+private:
+    void write(const std::string &payload, uint64_t timestamp)
+    {
+        static const char padding[8] = {0};
+
+        ReplayHeader header = {(uint32_t)payload.size(), 0, timestamp};
+        size_t pad = ReplayFormat::Padded(payload.size()) - payload.size();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_file != nullptr &&
+            (fwrite(&header, sizeof(header), 1, _file) != 1 ||
+             fwrite(payload.data(), 1, payload.size(), _file) != payload.size() ||
+             fwrite(padding, 1, pad, _file) != pad))
+        {
+            fail("write");
+        }
+    }
+
+    // Report failure once and stop writing, called with mutex held
+    void fail(const char *operation)
+    {
+        fprintf(stderr, "ReplayRecorder: failed to %s replay file\n", operation);
+        _failed = true;
+        close_file();
+    }
+
+    void close_file()
+    {
+        if (_file != nullptr)
+        {
+            if (fclose(_file) != 0 && !_failed)
+            {
+                fprintf(stderr, "ReplayRecorder: failed to flush replay file\n");
+                _failed = true;
+            }
+            _file = nullptr;
+        }
+    }
+
+    std::mutex _mutex;
+    FILE *_file;
+    std::atomic<bool> _failed;
+    std::atomic<uint64_t> _skipped;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_REPLAY_RECORDER_H_ */
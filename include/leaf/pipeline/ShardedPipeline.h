@@ -0,0 +1,192 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_SHARDED_PIPELINE_H_
+#define _LEAF_SHARDED_PIPELINE_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include <stdint.h>
+
+#include <tbb/task_arena.h>
+
+#include "Arena.h"
+#include "Pipeline.h"
+
+namespace leaf {
+
+// One pipeline replica per NUMA node. Each replica is built inside an arena pinned
+// to CPUs of its node, so its graph runs there and memory it first touches stays
+// on the node. Frames are routed by key hash if set, otherwise round robin.
+template <class _FrameT>
+class ShardedPipeline
+{
+public:
+    typedef Pipeline<_FrameT> pipeline;
+    typedef std::function<pipeline *(size_t)> factory;
+    typedef std::function<size_t(const typename _FrameT::ptr &)> key_hash;
+
+    // Factory called once per shard with shard index, by default one shard per NUMA node
+    ShardedPipeline(factory create, std::vector<std::vector<int32_t>> nodes = NumaNodes())
+        : _next(0)
+    {
+        for (auto &cpus : nodes)
+        {
+            std::unique_ptr<Shard> shard(new Shard());
+            int32_t concurrency = cpus.empty() ? tbb::this_task_arena::max_concurrency() : (int32_t)cpus.size();
+
+            shard->arena.reset(new IsolatedArena(concurrency, cpus));
+            shard->arena->execute([&]() { shard->replica.reset(create(_shards.size())); });
+
+            _shards.push_back(std::move(shard));
+        }
+    }
+
+    // CPUs of every online NUMA node with CPUs, memory-only nodes are skipped.
+    // A single unpinned node if topology unknown.
+    static std::vector<std::vector<int32_t>> NumaNodes()
+    {
+        std::vector<std::vector<int32_t>> nodes;
+
+        for (auto node : ArenaAffinity::OnlineNodes())
+        {
+            std::vector<int32_t> cpus = ArenaAffinity::NodeCpus(node);
+
+            if (!cpus.empty())
+            {
+                nodes.push_back(cpus);
+            }
+        }
+
+        if (nodes.empty())
+        {
+            nodes.push_back(std::vector<int32_t>());
+        }
+        return nodes;
+    }
+
+    // Set before frames flow, frames of equal key go to the same shard
+    void set_key_hash(key_hash hash)
+    {
+        _hash = hash;
+    }
+
+    // Push frame into shard chosen by key hash, or next shard not overloaded
+    bool push_frame(typename _FrameT::ptr frame, int32_t priority = 0)
+    {
+        return push_frame(frame == nullptr ? 0 : route(frame), frame, priority);
+    }
+
+    // Push frame into given shard
+    bool push_frame(size_t shard, typename _FrameT::ptr frame, int32_t priority = 0)
+    {
+        return _shards[shard]->replica->push_frame(frame, priority);
+    }
+
+    // Check if every shard overloaded
+    bool overload()
+    {
+        for (auto &shard : _shards)
+        {
+            if (!shard->replica->overload())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Check if shard overloaded
+    bool overload(size_t shard)
+    {
+        return _shards[shard]->replica->overload();
+    }
+
+    // Wait for every shard finish
+    void wait_finish()
+    {
+        for (auto &shard : _shards)
+        {
+            shard->replica->wait_finish();
+        }
+    }
+
+    // Run function in arena of shard, for producers, frames and buffers to be node local
+    template <typename _FuncT>
+    void execute(size_t shard, const _FuncT &func)
+    {
+        _shards[shard]->arena->execute(func);
+    }
+
+    size_t shard_count()
+    {
+        return _shards.size();
+    }
+
+    pipeline &shard(size_t shard)
+    {
+        return *_shards[shard]->replica;
+    }
+
+private:
+    struct Shard
+    {
+        std::unique_ptr<IsolatedArena> arena;
+        // Destroyed before arena
+        std::unique_ptr<pipeline> replica;
+    };
+
+    size_t route(const typename _FrameT::ptr &frame)
+    {
+        if (_hash)
+        {
+            return _hash(frame) % _shards.size();
+        }
+
+        size_t first = _next.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < _shards.size(); i++)
+        {
+            size_t shard = (first + i) % _shards.size();
+
+            if (!_shards[shard]->replica->overload())
+            {
+                return shard;
+            }
+        }
+        return first % _shards.size();
+    }
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    key_hash _hash;
+    std::atomic<size_t> _next;
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_SHARDED_PIPELINE_H_ */
@@ -25,24 +25,37 @@
 #ifndef _LEAF_STATISTIC_H_
 #define _LEAF_STATISTIC_H_
 
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <vector>
 #include <string>
 #include <limits>
-#include <sstream>
-#include <typeinfo>
+#include <algorithm>
 
 #include <math.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
 
-#include <tbb/tick_count.h>
+#include <tbb/spin_mutex.h>
 #include <tbb/concurrent_unordered_map.h>
+#include <tbb/enumerable_thread_specific.h>
 
+// Module timing is a runtime switch, Statistic::StartRecording() turns it on.
+// Defining MODULE_TIMMING keeps the old build switch working: recording starts on.
 // #define MODULE_TIMMING
 
 namespace leaf {
 
+// Kind of recorded time
+enum class StatisticKind
+{
+    Runtime, // Time spent inside module
+    Wait,    // Time frames waited in front of module
+    Latency  // Push to end latency of frames
+};
+
 struct ModuleStatistic
 {
     std::string name;
@@ -50,12 +63,243 @@ struct ModuleStatistic
     float std;
     float min;
     float max;
+    float p50;
+    float p99;
+    float p999;
     int64_t count;
 };
 
+// Log-linear latency histogram in nanoseconds, relative error within 1 / SubBucketCount.
+// Written by one thread without atomic read-modify-write, read by any thread.
+class LatencyHistogram
+{
+public:
+    static const int32_t SubBucketBits = 5;
+    static const int32_t SubBucketCount = 1 << SubBucketBits;
+    // Values above 2^MaxExponent ns (about 18 minutes) fall into last bucket
+    static const int32_t MaxExponent = 40;
+    static const int32_t BucketCount = (MaxExponent - SubBucketBits + 2) * SubBucketCount;
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void record(uint64_t ns)
+    {
+        increase(_buckets[BucketIndex(ns)], 1);
+        increase(_count, 1);
+        increase(_sum, ns);
+
+        double sum2 = _sum2.load(std::memory_order_relaxed);
+        _sum2.store(sum2 + (double)ns * ns, std::memory_order_relaxed);
+
+        if (ns < _min.load(std::memory_order_relaxed))
+        {
+            _min.store(ns, std::memory_order_relaxed);
+        }
+        if (ns > _max.load(std::memory_order_relaxed))
+        {
+            _max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    // Zero all counters, samples recorded meanwhile may be partly lost
+    void reset()
+    {
+        for (int32_t i = 0; i < BucketCount; i++)
+        {
+            _buckets[i].store(0, std::memory_order_relaxed);
+        }
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+        _sum2.store(0, std::memory_order_relaxed);
+        _min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+    }
+
+    // Histogram merged from several writers
+    struct Merged
+    {
+        Merged() : buckets(BucketCount, 0), count(0), sum(0), sum2(0),
+                   min(std::numeric_limits<uint64_t>::max()), max(0)
+        {
+        }
+
+        // Value at quantile q in [0, 1]
+        uint64_t percentile(double q) const
+        {
+            uint64_t rank = (uint64_t)ceil(q * count);
+            uint64_t seen = 0;
+
+            for (int32_t i = 0; i < BucketCount; i++)
+            {
+                seen += buckets[i];
+                if (seen >= rank && seen > 0)
+                {
+                    return std::min(std::max(BucketValue(i), min), max);
+                }
+            }
+            return max;
+        }
+
+        std::vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t sum;
+        double sum2;
+        uint64_t min;
+        uint64_t max;
+    };
+
+    void merge_to(Merged &merged) const
+    {
+        for (int32_t i = 0; i < BucketCount; i++)
+        {
+            merged.buckets[i] += _buckets[i].load(std::memory_order_relaxed);
+        }
+        merged.count += _count.load(std::memory_order_relaxed);
+        merged.sum += _sum.load(std::memory_order_relaxed);
+        merged.sum2 += _sum2.load(std::memory_order_relaxed);
+        merged.min = std::min(merged.min, _min.load(std::memory_order_relaxed));
+        merged.max = std::max(merged.max, _max.load(std::memory_order_relaxed));
+    }
+
+    static int32_t BucketIndex(uint64_t ns)
+    {
+        if (ns < (uint64_t)SubBucketCount)
+        {
+            return (int32_t)ns;
+        }
+
+        int32_t msb = 63 - __builtin_clzll(ns);
+
+        if (msb > MaxExponent)
+        {
+            return BucketCount - 1;
+        }
+
+        int32_t shift = msb - SubBucketBits;
+        return (shift + 1) * SubBucketCount + (int32_t)((ns >> shift) - SubBucketCount);
+    }
+
+    // Middle value of bucket
+    static uint64_t BucketValue(int32_t index)
+    {
+        if (index < 2 * SubBucketCount)
+        {
+            return index;
+        }
+
+        int32_t shift = index / SubBucketCount - 1;
+        uint64_t lower = (uint64_t)(index % SubBucketCount + SubBucketCount) << shift;
+        return lower + ((uint64_t)1 << shift) / 2;
+    }
+
+private:
+    static void increase(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> _buckets[BucketCount];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<double> _sum2;
+    std::atomic<uint64_t> _min;
+    std::atomic<uint64_t> _max;
+};
+
+// Runtime of one module, one histogram per recording thread
+class RuntimeRecorder
+{
+public:
+    // Threads with dense index below SlotCount find their histogram without hashing
+    static const size_t SlotCount = 256;
+
+    RuntimeRecorder() : _local(nullptr)
+    {
+        for (size_t i = 0; i < SlotCount; i++)
+        {
+            _slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t ns)
+    {
+        size_t index = ThreadIndex();
+        LatencyHistogram *histogram = index < SlotCount ? _slots[index].load(std::memory_order_relaxed) : nullptr;
+
+        if (histogram == nullptr)
+        {
+            histogram = &local();
+        }
+        histogram->record(ns);
+    }
+
+    // Dense index of calling thread, assigned on first use and never reused
+    static size_t ThreadIndex()
+    {
+        static std::atomic<size_t> next(0);
+        static thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    void reset()
+    {
+        tbb::spin_mutex::scoped_lock lock(_mutex);
+
+        for (auto &histogram : _histograms)
+        {
+            histogram->reset();
+        }
+    }
+
+    LatencyHistogram::Merged merge()
+    {
+        LatencyHistogram::Merged merged;
+        tbb::spin_mutex::scoped_lock lock(_mutex);
+
+        for (auto &histogram : _histograms)
+        {
+            histogram->merge_to(merged);
+        }
+        return merged;
+    }
+
+private:
+    // Histogram of calling thread, registered once per thread and cached in its slot
+    LatencyHistogram &local()
+    {
+        LatencyHistogram *&histogram = _local.local();
+
+        if (histogram == nullptr)
+        {
+            histogram = new LatencyHistogram();
+
+            tbb::spin_mutex::scoped_lock lock(_mutex);
+            _histograms.emplace_back(histogram);
+        }
+
+        size_t index = ThreadIndex();
+        if (index < SlotCount)
+        {
+            _slots[index].store(histogram, std::memory_order_relaxed);
+        }
+        return *histogram;
+    }
+
+    // Only the owning thread reads and writes its slot
+    std::atomic<LatencyHistogram *> _slots[SlotCount];
+    tbb::enumerable_thread_specific<LatencyHistogram *> _local;
+
+    tbb::spin_mutex _mutex;
+    std::vector<std::unique_ptr<LatencyHistogram>> _histograms;
+};
+
 class Statistic
 {
 public:
+    // Unused, histograms keep every sample since StartRecording
     static int32_t &MaxRecordLength()
     {
         static int32_t max_record_length = 500;
@@ -64,7 +308,13 @@ public:
 
     static void StartRecording()
     {
-        RuntimeMap().clear();
+        for (auto map : {&RuntimeMap(), &WaitMap(), &LatencyMap()})
+        {
+            for (auto &pair : *map)
+            {
+                pair.second->reset();
+            }
+        }
         Recording() = true;
     }
 
@@ -73,89 +323,179 @@ public:
         Recording() = false;
     }
 
+    // Check recording switch, cheap enough for every module call
+    static bool IsRecording()
+    {
+        return Recording().load(std::memory_order_relaxed);
+    }
+
+    // Resolve recorder of module once, pointer stays valid for program lifetime
+    static RuntimeRecorder *Resolve(const std::string &name)
+    {
+        return &Recorder(RuntimeMap(), name);
+    }
+
+    // Resolve recorder of time frames wait in front of module
+    static RuntimeRecorder *ResolveWait(const std::string &name)
+    {
+        return &Recorder(WaitMap(), name);
+    }
+
+    // Resolve recorder of push to end latency
+    static RuntimeRecorder *ResolveLatency(const std::string &name)
+    {
+        return &Recorder(LatencyMap(), name);
+    }
+
+    // Monotonic time in ns for runtime recording
+    static uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Record module runtime in ms
     static void RecordRuntime(std::string name, float interval)
     {
         if (Recording())
         {
-            RuncountMap()[name] = RuncountMap()[name] + 1;
+            Recorder(RuntimeMap(), name).record((uint64_t)(interval * 1e6f));
+        }
+    }
 
-            std::deque<float> &q = RuntimeMap()[name];
+    // Module runtime, time spent inside module
+    static std::vector<ModuleStatistic> &GetStatistic()
+    {
+        static std::vector<ModuleStatistic> stats;
+        return Summarize(RuntimeMap(), stats);
+    }
 
-            q.push_back(interval);
+    // Time frames waited in queues in front of each module
+    static std::vector<ModuleStatistic> &GetWaitStatistic()
+    {
+        static std::vector<ModuleStatistic> stats;
+        return Summarize(WaitMap(), stats);
+    }
 
-            if (q.size() > MaxRecordLength())
-                q.pop_front();
+    // Push to end latency of frames
+    static std::vector<ModuleStatistic> &GetLatencyStatistic()
+    {
+        static std::vector<ModuleStatistic> stats;
+        return Summarize(LatencyMap(), stats);
+    }
+
+    // Copy of statistic for exporters, Get*Statistic share static storage of caller
+    static std::vector<ModuleStatistic> Collect(StatisticKind kind)
+    {
+        std::vector<ModuleStatistic> stats;
+
+        switch (kind)
+        {
+        case StatisticKind::Runtime:
+            return Summarize(RuntimeMap(), stats);
+        case StatisticKind::Wait:
+            return Summarize(WaitMap(), stats);
+        case StatisticKind::Latency:
+            return Summarize(LatencyMap(), stats);
         }
+        return stats;
     }
 
-    static std::vector<ModuleStatistic> &GetStatistic()
+    static void PrintStatistic()
     {
-        static std::vector<ModuleStatistic> stats;
+        PrintTable("Module Runtime (ms)", GetStatistic());
+        PrintTable("Queue Wait (ms)", GetWaitStatistic());
+        PrintTable("End to End Latency (ms)", GetLatencyStatistic());
+    }
 
+private:
+    typedef tbb::concurrent_unordered_map<std::string, std::shared_ptr<RuntimeRecorder>> recorder_map;
+
+    static std::vector<ModuleStatistic> &Summarize(recorder_map &map, std::vector<ModuleStatistic> &stats)
+    {
         stats.clear();
 
-        for (auto &pair : RuntimeMap())
+        for (auto &pair : map)
         {
-            auto &q = pair.second;
+            LatencyHistogram::Merged merged = pair.second->merge();
 
-            float sum = 0;
-            float sum2 = 0;
-            float min = std::numeric_limits<float>::max();
-            float max = -std::numeric_limits<float>::max();
-
-            for (size_t i = 0; i < q.size(); i++)
+            if (merged.count == 0)
             {
-                sum += q[i];
-                sum2 += q[i] * q[i];
-
-                if (q[i] > max)
-                    max = q[i];
-                if (q[i] < min)
-                    min = q[i];
+                continue;
             }
 
-            float avg = sum / q.size();
-            float avg2 = sum2 / q.size();
-            float std = sqrt(avg2 - avg * avg);
+            double avg = (double)merged.sum / merged.count;
+            double avg2 = merged.sum2 / merged.count;
+            double std = sqrt(std::max(avg2 - avg * avg, 0.0));
 
-            int64_t count = RuncountMap()[pair.first];
-
-            stats.push_back({pair.first, avg, std, min, max, count});
+            stats.push_back({pair.first, (float)(avg / 1e6), (float)(std / 1e6),
+                             merged.min / 1e6f, merged.max / 1e6f,
+                             merged.percentile(0.5) / 1e6f, merged.percentile(0.99) / 1e6f,
+                             merged.percentile(0.999) / 1e6f, (int64_t)merged.count});
         }
         return stats;
     }
 
-    static void PrintStatistic()
+    // Print table of statistic, skip table without samples
+    static void PrintTable(const char *title, std::vector<ModuleStatistic> &stats)
     {
-        auto &stats = GetStatistic();
+        if (stats.empty())
+        {
+            return;
+        }
+
+        std::string rule = "=========================== " + std::string(title) + " ";
+        rule.resize(std::max(rule.size(), (size_t)78), '=');
 
-        printf("================= Module Runtime (ms) ====================\n");
-        printf("Name                  Average   StdDev   Min   Max   Count\n");
-        printf("----------------------------------------------------------\n");
+        printf("%s\n", rule.c_str());
+        printf("Name                  Average   StdDev   Min   Max   P50   P99   P999   Count\n");
+        printf("------------------------------------------------------------------------------\n");
         for (auto &module : stats)
         {
-            printf("%s  %.4f  %.4f  %.4f  %.4f  %" PRId64 "\n", module.name.c_str(),
-                    module.avg, module.std, module.min, module.max, module.count);
+            printf("%s  %.4f  %.4f  %.4f  %.4f  %.4f  %.4f  %.4f  %" PRId64 "\n", module.name.c_str(),
+                    module.avg, module.std, module.min, module.max,
+                    module.p50, module.p99, module.p999, module.count);
         }
-        printf("================= Module Runtime (ms) ====================\n");
+        printf("%s\n", rule.c_str());
     }
 
-private:
-    static tbb::concurrent_unordered_map<std::string, std::deque<float>> &RuntimeMap()
+    static RuntimeRecorder &Recorder(recorder_map &map, const std::string &name)
+    {
+        auto iter = map.find(name);
+
+        if (iter == map.end())
+        {
+            iter = map.insert(std::make_pair(name, std::make_shared<RuntimeRecorder>())).first;
+        }
+        return *iter->second;
+    }
+
+    static recorder_map &RuntimeMap()
     {
-        static tbb::concurrent_unordered_map<std::string, std::deque<float>> runtime_map;
+        static recorder_map runtime_map;
         return runtime_map;
     }
 
-    static tbb::concurrent_unordered_map<std::string, int64_t> &RuncountMap()
+    static recorder_map &WaitMap()
+    {
+        static recorder_map wait_map;
+        return wait_map;
+    }
+
+    static recorder_map &LatencyMap()
     {
-        static tbb::concurrent_unordered_map<std::string, int64_t> runcount_map;
-        return runcount_map;
+        static recorder_map latency_map;
+        return latency_map;
     }
 
-    static bool &Recording()
+    static std::atomic<bool> &Recording()
     {
-        static bool recording = true;
+        // Off until StartRecording unless built with MODULE_TIMMING, module calls then skip clock reads
+#ifdef MODULE_TIMMING
+        static std::atomic<bool> recording(true);
+#else
+        static std::atomic<bool> recording(false);
+#endif
         return recording;
     }
 };
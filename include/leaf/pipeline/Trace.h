@@ -0,0 +1,344 @@
+/*
+ * License Agreement
+ * 
+ * Copyright (c) 2020 Longsheng Du
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LEAF_TRACE_H_
+#define _LEAF_TRACE_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <tbb/spin_mutex.h>
+#include <tbb/concurrent_unordered_map.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "../buffer/RingQueue.h"
+
+namespace leaf {
+
+// One stage execution of a traced frame, times in ns
+struct TraceEvent
+{
+    const char *name;
+    uint64_t frame;
+    uint64_t enqueue;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Per-frame tracing into Chrome trace JSON, readable by chrome://tracing and Perfetto.
+// Events go into a lock-free ring of the recording thread, a flush thread drains rings
+// into file. Events are dropped while a ring is full. Off, tracing costs one relaxed load.
+class Trace
+{
+public:
+    static size_t &RingCapacity()
+    {
+        static size_t ring_capacity = 1 << 14;
+        return ring_capacity;
+    }
+
+    // Start tracing every sample_every-th pushed frame into file at path
+    static bool Start(const std::string &path, uint32_t sample_every = 1)
+    {
+        TraceState &state = State();
+        std::lock_guard<std::mutex> control(state.control);
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (state.file != nullptr)
+        {
+            return false;
+        }
+
+        state.file = fopen(path.c_str(), "w");
+
+        if (state.file == nullptr)
+        {
+            return false;
+        }
+
+        // Events left from an earlier trace do not belong to this one
+        Discard(state);
+
+        fprintf(state.file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        state.first = true;
+        state.stop = false;
+        state.dropped = 0;
+        state.sample_every = sample_every > 0 ? sample_every : 1;
+        state.flusher = std::thread(Flush);
+
+        Tracing() = true;
+        return true;
+    }
+
+    // Stop tracing, write remaining events and close file. Records already past
+    // their tracing check finish before the last drain.
+    static void Stop()
+    {
+        TraceState &state = State();
+        std::lock_guard<std::mutex> control(state.control);
+
+        Tracing() = false;
+        Quiesce(state);
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stop = true;
+        }
+        state.cond.notify_all();
+
+        if (state.flusher.joinable())
+        {
+            state.flusher.join();
+        }
+    }
+
+    static bool IsTracing()
+    {
+        return Tracing().load(std::memory_order_relaxed);
+    }
+
+    // Check if pushed frame with sequence number is sampled
+    static bool Sampled(size_t sequence)
+    {
+        return IsTracing() && sequence % State().sample_every.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Stable JSON escaped name pointer for events, resolve once per stage
+    static const char *Resolve(const std::string &name)
+    {
+        // Map nodes never move, value string outlives every event
+        auto iter = Names().insert(std::make_pair(name, Escape(name))).first;
+        return iter->second.c_str();
+    }
+
+    // Record stage execution of frame, frame waited in queue from enqueue to begin
+    static void Record(const char *name, uint64_t frame, uint64_t enqueue, uint64_t begin, uint64_t end)
+    {
+        if (!IsTracing())
+        {
+            return;
+        }
+
+        TraceEvent event = {name, frame, enqueue, begin, end};
+        ThreadRing &local = Local();
+
+        // Stop waits for busy rings, recheck after marking busy
+        local.busy.store(true);
+
+        if (Tracing().load() && !local.ring.try_push(event))
+        {
+            State().dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        local.busy.store(false, std::memory_order_release);
+    }
+
+    // Events lost to full rings since Start
+    static uint64_t Dropped()
+    {
+        return State().dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct ThreadRing
+    {
+        ThreadRing(uint32_t id) : ring(RingCapacity()), tid(id), busy(false) {}
+
+        SPSCRing<TraceEvent> ring;
+        uint32_t tid;
+        // Recording thread is between tracing check and push
+        std::atomic<bool> busy;
+    };
+
+    struct TraceState
+    {
+        TraceState() : file(nullptr), first(true), stop(true), sample_every(1), dropped(0) {}
+
+        // Serializes Start and Stop
+        std::mutex control;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::thread flusher;
+        FILE *file;
+        bool first;
+        bool stop;
+
+        std::atomic<uint32_t> sample_every;
+        std::atomic<uint64_t> dropped;
+
+        tbb::spin_mutex rings_mutex;
+        std::vector<std::unique_ptr<ThreadRing>> rings;
+    };
+
+    // Flush thread, drain rings periodically until stopped
+    static void Flush()
+    {
+        TraceState &state = State();
+        std::unique_lock<std::mutex> lock(state.mutex);
+
+        while (!state.cond.wait_for(lock, std::chrono::milliseconds(10), [&]() { return state.stop; }))
+        {
+            Drain(state);
+        }
+
+        Drain(state);
+
+        fprintf(state.file, "\n]}\n");
+        fclose(state.file);
+        state.file = nullptr;
+    }
+
+    static std::vector<ThreadRing *> Rings(TraceState &state)
+    {
+        std::vector<ThreadRing *> rings;
+        tbb::spin_mutex::scoped_lock lock(state.rings_mutex);
+
+        for (auto &ring : state.rings)
+        {
+            rings.push_back(ring.get());
+        }
+        return rings;
+    }
+
+    // Wait for records in progress after tracing was switched off
+    static void Quiesce(TraceState &state)
+    {
+        for (auto ring : Rings(state))
+        {
+            while (ring->busy.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    static void Discard(TraceState &state)
+    {
+        TraceEvent event;
+
+        for (auto ring : Rings(state))
+        {
+            while (ring->ring.try_pop(event))
+            {
+            }
+        }
+    }
+
+    static void Drain(TraceState &state)
+    {
+        TraceEvent event;
+
+        for (auto ring : Rings(state))
+        {
+            while (ring->ring.try_pop(event))
+            {
+                fprintf(state.file,
+                        "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"args\":{\"frame\":%" PRIu64 ",\"wait_us\":%.3f}}",
+                        state.first ? "" : ",\n", event.name, ring->tid, event.begin / 1e3,
+                        (event.end - event.begin) / 1e3, event.frame,
+                        event.begin > event.enqueue ? (event.begin - event.enqueue) / 1e3 : 0.0);
+                state.first = false;
+            }
+        }
+    }
+
+    // Ring of calling thread, registered once per thread and kept for program lifetime
+    static ThreadRing &Local()
+    {
+        static tbb::enumerable_thread_specific<ThreadRing *> local(nullptr);
+        ThreadRing *&ring = local.local();
+
+        if (ring == nullptr)
+        {
+            TraceState &state = State();
+            tbb::spin_mutex::scoped_lock lock(state.rings_mutex);
+
+            ring = new ThreadRing((uint32_t)state.rings.size() + 1);
+            state.rings.emplace_back(ring);
+        }
+        return *ring;
+    }
+
+    // State is never destroyed, events may be recorded during static destruction
+    static TraceState &State()
+    {
+        static TraceState *state = new TraceState();
+        return *state;
+    }
+
+    // Names are never destroyed either, events point into them
+    static tbb::concurrent_unordered_map<std::string, std::string> &Names()
+    {
+        static tbb::concurrent_unordered_map<std::string, std::string> *names =
+            new tbb::concurrent_unordered_map<std::string, std::string>();
+        return *names;
+    }
+
+    // Escape quote, backslash and control characters for JSON string
+    static std::string Escape(const std::string &name)
+    {
+        std::string escaped;
+
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                escaped += code;
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    static std::atomic<bool> &Tracing()
+    {
+        static std::atomic<bool> tracing(false);
+        return tracing;
+    }
+};
+
+} // namespace leaf
+
+#endif /* _LEAF_TRACE_H_ */